@@ -0,0 +1,39 @@
+/*
+  decoder.cpp - host decoder of the uplink payload, built from the same schema
+  as the node (../main/payload.h)
+
+  build: g++ -O2 -I../../../libs/BitPack -o decoder decoder.cpp
+  usage: echo <hex payload> | ./decoder
+         one payload per line (delta coded batch, see DeltaCodec.h),
+         one CSV line per record (physical units), oldest first
+*/
+
+#include <stdio.h>
+#include <ctype.h>
+
+#include "../main/payload.h"
+#include "DeltaCodec.h"
+
+int main() {
+  char line[520];
+  uint8_t buf[255];
+  int32_t values[DeltaCodec<Payload>::maxRecords * Payload::fields];
+
+  while (fgets(line, sizeof(line), stdin)) {
+    unsigned len = 0;
+    for (char *p = line; isxdigit(p[0]) && isxdigit(p[1]) && len < sizeof(buf); p += 2) {
+      sscanf(p, "%2hhx", &buf[len++]);
+    }
+
+    uint8_t count = DeltaCodec<Payload>::decode(buf, len, values, DeltaCodec<Payload>::maxRecords);
+    for (uint16_t n = 0; n < (uint16_t)count * Payload::fields; n++) {
+      uint8_t i = n % Payload::fields;
+      printf(i ? ",%g" : "%g", (double)values[n] / Payload::scale(i));
+      if (i == Payload::fields - 1) {
+        printf("\n");
+      }
+    }
+  }
+
+  return 0;
+}
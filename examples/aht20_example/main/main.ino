@@ -4,13 +4,16 @@
 #include <avr/power.h>
 
 #include "LoRaWAN.h"
+#include "FrameCounter.h"
+#include "payload.h"
 #include "secconfig.h"
-#include "tinySPI.h"
+#include "UsiBus.h"
 
 
 /* Add your include statements here */
 /* USER CODE BEGIN */
 #include <AHT20.h>
+#include <SampleBatch.h>
 //#include <SoftwareSerial.h>
 /* USER CODE END */
 
@@ -26,7 +29,7 @@ RFM95 rfm(DIO0, NSS);
 
 /* Define LoRaWAN layer */
 LoRaWAN lora = LoRaWAN(rfm);
-uint32_t Frame_Counter_Tx = 0x0000;
+FrameCounter Frame_Counter_Tx(0, 16, 32); // EEPROM ring: 16 slots from address 0, checkpoint every 32 frames
 const byte SF = 7;        // set spreading factor
 uint8_t PA_boost_on = 1;   // set power amplifier 
 uint8_t power_level = 2;   // set Tx power (in dBm)
@@ -38,6 +41,11 @@ volatile uint16_t sleep_count = sleep_total + 1; // count elapsed sleep cycles
 /* USER CODE BEGIN */
 // Add your variables/constructors definitions here:
 AHT20 aht20;
+
+// one sample per wake-up, sent in batches of 8 (or after 15 wake-ups at the latest),
+// delta coded: ~5-9 bytes instead of 18 for slowly changing readings
+SampleBatch<Payload, 8> batch;
+const uint16_t batch_deadline = 15;
 /* USER CODE END */
 
 
@@ -69,12 +77,12 @@ void setup() {
   // Initialize RFM module
   rfm.init(power_level, PA_boost_on);
   lora.setKeys(NwkSkey, AppSkey, DevAddr);
+  lora.setADR(1);  // SF and Tx power driven by the network (SF and power_level are the starting point)
+  Frame_Counter_Tx.begin(); // restore the frame counter after a reset
 
-  /* 
-   * Force SCK high (external sensor has pull-ups 
-   * that drain current if not properly driven) 
-   */
-  pinMode(4, INPUT_PULLUP);
+  // park the USI pins (external sensor has pull-ups that drain current if
+  // not properly driven)
+  UsiBus::release();
 }
 
 
@@ -82,6 +90,7 @@ void loop() {
 
   // sleep:
   goToSleep();
+  lora.Time_Elapsed(8000); // one watchdog period (ms), keeps the network duty cycle
 
   // Once awake check sleep counter:
   if (sleep_count >= sleep_total) { // if time to awake:
@@ -91,16 +100,12 @@ void loop() {
     
     //serial.println(F("awake!"));
   
-    uint8_t Data_Length = 4;
-    uint8_t Data[Data_Length];
-
-    // Ensure SPI is in high impedance mode:
-    digitalWrite(NSS, HIGH);
-    SPI.end();
-    delay(1);
+    uint8_t Data_Length;
+    uint8_t Data[batch.deltaBytes];
 
-    // initialize your sensor and I2C line
-    bool stat = aht20.begin();
+    // initialize the sensor, if not calibrated yet (the drivers and the
+    // RFM95 switch the shared USI between I2C and SPI themselves)
+    bool stat = aht20.resume();
 
     if (!stat) {
       //serial.println(F("Err init"));
@@ -113,42 +118,25 @@ void loop() {
       //serial.println(F("Err reading"));
     }
 
-    // get your measurements here:
-    float hum  = aht20.getHumidity();
-    float temp = aht20.getTemperature();
-
-    uint16_t hum_int  = hum*100;
-    uint16_t temp_int = temp*100;
-
-    Data[0] = (hum_int >> 8) & 0xFF;
-    Data[1] = hum_int & 0xFF;
-    Data[2] = (temp_int >> 8) & 0xFF;
-    Data[3] = temp_int & 0xFF;
-
-    // de-initialize I2C pins:
-    // close I2C resources --> I2C pins can be used for SPI now...
-    USIDR = 0x00; 
-    USICR = 0x00;
-    USISR = 0x00;
-    USIBR = 0x00;
-
-    PORTA &= ~(1 << PORTA6); // Set SDA in high inpedance state
-    PORTA &= ~(1 << PORTA4); // Set SCL in high impedance state
-
-    // set both as input:
-    DDRA &= ~((1 << DDA6) | (1 << DDA4));
+    // get your measurements here (0.01 %RH, 0.01 °C), bit-packed as described
+    // in payload.h; corrupted samples (CRC) are dropped
+    if (stat) {
+      batch.add(aht20.getHumidityCenti(), aht20.getTemperatureCenti());
+    }
+    batch.tick();
 
     /* USER CODE END */
 
     //prepara LoRa:
-    SPI.setDataMode(SPI_MODE0);
-    SPI.begin();
     //rfm.init(power_level, PA_boost_on);
 
-    // transmit data
-    lora.Send_Data(Data, Data_Length, Frame_Counter_Tx, SF);
-
-    Frame_Counter_Tx++;
+    // transmit data: the whole batch (samples oldest first, delta coded)
+    if (batch.ready(batch_deadline)) {
+      Data_Length = batch.readDelta(Data);
+      if (lora.Send_Data(Data, Data_Length, Frame_Counter_Tx.next(), SF) != LORAWAN_DUTY_CYCLE) {
+        batch.clear();
+      }
+    }
 
     // reset sleep count
     sleep_count = 0;
@@ -156,12 +144,8 @@ void loop() {
     /* USER CODE BEGIN */
     // additional code for low power implementation
 
-    /* 
-     * Force SCK high (external sensor has pull-ups 
-     * that drain current if not properly driven) 
-     */
-    delay(1);
-    pinMode(4, INPUT_PULLUP); 
+    // park the USI pins until the next wake-up
+    UsiBus::release();
     /* USER CODE END */
   }
   // come back to sleep
@@ -280,9 +264,12 @@ void setup_unused_pins(){
   Interrupt handler: 
   - code here must be executed as fast as possible (increment counter or set a flag)!
   - declare sleep_count as volatile variable for faster execution;
+  - the timeouts of TinySleep (LoRaWAN receive windows, sensor waits) are not sleep cycles;
 */
 ISR(WDT_vect) {
-  sleep_count++; // keep track of how many sleep cycles have been completed.
+  if (!TinySleep::sleeping()) {
+    sleep_count++; // keep track of how many sleep cycles have been completed.
+  }
 }
 
 
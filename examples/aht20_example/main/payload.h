@@ -0,0 +1,16 @@
+/*
+  payload.h - uplink payload schema, shared with the host decoder (../decoder)
+*/
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include "BitPack.h"
+
+// 18 bits -> 3 bytes (4 bytes with two uint16_t x100)
+typedef BitPack<
+  BitField<0, 10000, 50, 100>,    // humidity: 0..100 %RH, 0.5 %RH (0.01 %RH units)
+  BitField<-2000, 6000, 10, 100>  // temperature: -20..60 °C, 0.1 °C (0.01 °C units)
+> Payload;
+
+#endif
@@ -0,0 +1,58 @@
+/*
+  decoder.cpp - host decoder of the uplink payload, built from the same schema
+  as the node (../main/payload.h)
+
+  build: g++ -O2 -I../../../libs/BitPack -o decoder decoder.cpp
+  usage: echo <hex payload> | ./decoder [fport]
+         one payload per line, one CSV line per record (physical units)
+         FPort 2: readings sent late from the EEPROM log, each record starts
+         with its age at the uplink time (first column, seconds)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "../main/payload.h"
+
+// FPort 2 record: 16 bit age (8 s watchdog ticks) + payload
+#define LOG_RECORD (2 + Payload::bytes)
+
+static void print(const uint8_t *buf, uint16_t bit) {
+  int32_t values[Payload::fields];
+
+  Payload::unpack(buf, bit, values);
+  for (uint8_t i = 0; i < Payload::fields; i++) {
+    printf(i ? ",%g" : "%g", (double)values[i] / Payload::scale(i));
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  char line[520];
+  uint8_t buf[256];
+  int port = argc > 1 ? atoi(argv[1]) : 1;
+
+  while (fgets(line, sizeof(line), stdin)) {
+    unsigned len = 0;
+    for (char *p = line; isxdigit(p[0]) && isxdigit(p[1]) && len < sizeof(buf); p += 2) {
+      sscanf(p, "%2hhx", &buf[len++]);
+    }
+
+    if (port == 2) {
+      // byte aligned records, oldest first
+      for (unsigned i = 0; i + LOG_RECORD <= len; i += LOG_RECORD) {
+        printf("%u,", (buf[i] << 8 | buf[i + 1]) * 8);
+        print(&buf[i + 2], 0);
+      }
+      continue;
+    }
+
+    // records are packed back to back
+    for (uint16_t bit = 0; bit + Payload::bits <= (int)len * 8; bit += Payload::bits) {
+      print(buf, bit);
+    }
+  }
+
+  return 0;
+}
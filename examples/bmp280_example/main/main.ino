@@ -4,14 +4,19 @@
 #include <avr/power.h>
 
 #include "LoRaWAN.h"
+#include "FrameCounter.h"
+#include "payload.h"
 #include "secconfig.h"
-#include "tinySPI.h"
+#include "UsiBus.h"
 
 
 /* Add your include statements here */
 /* USER CODE BEGIN */
 #include <AHT20.h>
 #include <BMP280.h>
+#include <SensorGroup.h>
+#include <ReportByException.h>
+#include <EepromLog.h>
 #include <SoftwareSerial.h>
 /* USER CODE END */
 
@@ -27,7 +32,7 @@ RFM95 rfm(DIO0, NSS);
 
 /* Define LoRaWAN layer */
 LoRaWAN lora = LoRaWAN(rfm);
-uint32_t Frame_Counter_Tx = 0x0000;
+FrameCounter Frame_Counter_Tx(0, 16, 32); // EEPROM ring: 16 slots from address 0, checkpoint every 32 frames
 const byte SF = 7;        // set spreading factor
 uint8_t PA_boost_on = 1;   // set power amplifier 
 uint8_t power_level = 2;   // set Tx power (in dBm)
@@ -42,6 +47,24 @@ AHT20 aht20;
 
 BMP280::Settings bmp280_settings;             // defalut settings structure (see BMP280.h): no OSR, no IIR, forced mode
 BMP280 bmp280(bmp280_settings, 0x77);  
+
+// both conversions run in parallel
+SensorGroup<AHT20, BMP280> sensors(aht20, bmp280);
+
+// send only when humidity moves by 1 %RH, temperature by 0.2 °C or pressure by 10 Pa,
+// and at least every 75 samples (10 minutes) as heartbeat
+ReportByException<100, 20, 10> report(75);
+bool report_due;
+
+// readings that the duty cycle did not let through: kept in the free EEPROM
+// (64-455, between the frame counter and the OTAA session) and sent later,
+// up to 8 per uplink on FPort 2 with their age
+EepromLog backlog(64, 392, Payload::bytes);
+const uint8_t backlog_batch = 8;
+// 1: confirmed uplinks, readings that get no ACK are stored and sent again
+// too; 0: only the duty cycle drops can be detected (and stored)
+const unsigned char confirmed = 0;
+uint16_t ticks;  // watchdog periods (8 s) since boot
 /* USER CODE END */
 
 
@@ -73,12 +96,19 @@ void setup() {
   //Initialize RFM module
   rfm.init(power_level, PA_boost_on);
   lora.setKeys(NwkSkey, AppSkey, DevAddr);
+  lora.setADR(1);  // SF and Tx power driven by the network (SF and power_level are the starting point)
+  Frame_Counter_Tx.begin(); // restore the frame counter after a reset
+
+  // stored readings: the tick count goes on from the newest one (the downtime is lost)
+  uint8_t record[Payload::bytes];
+  backlog.begin();
+  if (backlog.peek(backlog.count() - 1, ticks, record)) {
+    ticks++;
+  }
 
-  /* 
-   * Force SCK high (external sensor has pull-ups 
-   * that drain current if not properly driven) 
-   */
-  pinMode(4, INPUT_PULLUP);
+  // park the USI pins (external sensor has pull-ups that drain current if
+  // not properly driven)
+  UsiBus::release();
 }
 
 
@@ -86,6 +116,8 @@ void loop() {
 
   // sleep:
   goToSleep();
+  lora.Time_Elapsed(8000); // one watchdog period (ms), keeps the network duty cycle
+  ticks++;
 
   // Once awake check sleep counter:
   if (sleep_count >= sleep_total) { // if time to awake:
@@ -93,69 +125,61 @@ void loop() {
     /* USER CODE BEGIN */
     /* Read and prepare your sensor data here */
     
-    uint8_t Data_Length = 7;
-    uint8_t Data[Data_Length];
-
-    // Ensure SPI is in high impedance mode:
-    SPI.end();
-    delay(1);
-
-    /* AHT20 code: */   
-
-    // start I2C and init aht20:
-    aht20.begin();
-    
-    aht20.readData();
+    uint8_t Data_Length = Payload::bytes;
+    uint8_t Data[backlog_batch * (2 + Payload::bytes)];
+
+    // init aht20 only if not calibrated yet, bmp280 only the first time:
+    // calibration kept in RAM (the drivers and the RFM95 switch the shared
+    // USI between I2C and SPI themselves):
+    aht20.resume();
+    bmp280.resume();
+
+    // start both conversions, sleep until the slowest is due, read both;
+    // corrupted samples (CRC) are dropped
+    bool valid = sensors.sample();
     
-    // get your temperature and humidity measurements here:
-    float hum  = aht20.getHumidity();
-    float temp = aht20.getTemperature();
-
-    uint16_t hum_int  = hum*100;
-    uint16_t temp_int = temp*100;
-
-    Data[0] = (hum_int >> 8) & 0xFF;
-    Data[1] = hum_int & 0xFF;
-    Data[2] = (temp_int >> 8) & 0xFF;
-    Data[3] = temp_int & 0xFF;
-
-
-    /* BMP280 code: */
+    // get your measurements here (0.01 %RH, 0.01 °C, Pa):
+    int32_t hum_int   = aht20.getHumidityCenti();
+    int32_t temp_int  = aht20.getTemperatureCenti();
+    int32_t press_int = bmp280.getPressure();
 
-    // Start I2C and init bmp280:
-    bmp280.begin();
-
-    float bmp280_press = bmp280.readPressure(BMP280::PresUnit_Pa);
-
-    uint32_t bmp_press_int = bmp280_press*10;
-
-    Data[4] = (bmp_press_int >> 16) & 0xFF;
-    Data[5] = (bmp_press_int >> 8) & 0xFF;
-    Data[6] = bmp_press_int & 0xff;
-
-    // de-initialize I2C pins:
-    // close I2C resources --> I2C pins can be used for SPI now...
-    USIDR = 0x00; 
-    USICR = 0x00;
-    USISR = 0x00;
-    USIBR = 0x00;
-
-    PORTA &= ~(1 << PORTA6); // Set SDA in high inpedance state
-    PORTA &= ~(1 << PORTA4); // Set SCL in high impedance state
-
-    // set both as input:
-    DDRA &= ~((1 << DDA6) | (1 << DDA4));
+    // bit-packed as described in payload.h
+    report_due = valid && report.check(hum_int, temp_int, press_int);
+    Payload::pack(Data, 0, hum_int, temp_int, press_int);
 
     /* USER CODE END */
 
-    //prepara LoRa:
-    SPI.setDataMode(SPI_MODE0);
-    SPI.begin();
-
-    // transmit data
-    lora.Send_Data(Data, Data_Length, Frame_Counter_Tx, SF);
-
-    Frame_Counter_Tx++;
+    // transmit data (only on changes or heartbeat), or keep it in EEPROM if the
+    // duty cycle does not allow it or, for confirmed uplinks, if no ACK came
+    // back (packed again: Send_Data encrypts Data in place)
+    if (report_due) {
+      report.sent();
+      if (lora.Send_Data(Data, Data_Length, Frame_Counter_Tx.next(), SF, confirmed) < 0) {
+        Payload::pack(Data, 0, hum_int, temp_int, press_int);
+        backlog.push(ticks, Data);
+      }
+    }
+    // otherwise send the stored readings, oldest first: [age (ticks)][payload],
+    // removed once delivered (sent, and acknowledged if confirmed)
+    else if (backlog.count() > 0) {
+      uint8_t n = 0;
+      uint16_t stamp;
+
+      Data_Length = 0;
+      while (n < backlog_batch && backlog.peek(n, stamp, &Data[Data_Length + 2])) {
+        uint16_t age = ticks - stamp;
+        Data[Data_Length] = age >> 8;
+        Data[Data_Length + 1] = age & 0xFF;
+        Data_Length += 2 + Payload::bytes;
+        n++;
+      }
+
+      lora.setTxPort(2);
+      if (lora.Send_Data(Data, Data_Length, Frame_Counter_Tx.next(), SF, confirmed) >= 0) {
+        backlog.pop(n);
+      }
+      lora.setTxPort(1);
+    }
 
     // reset sleep count
     sleep_count = 0;
@@ -163,12 +187,8 @@ void loop() {
     /* USER CODE BEGIN */
     // additional code for low power implementation
 
-    /* 
-     * Force SCK high (external sensor has pull-ups 
-     * that drain current if not properly driven) 
-     */
-    delay(1);
-    pinMode(4, INPUT_PULLUP); 
+    // park the USI pins until the next wake-up
+    UsiBus::release();
     /* USER CODE END */
   }
   // come back to sleep
@@ -287,9 +307,12 @@ void setup_unused_pins(){
   Interrupt handler: 
   - code here must be executed as fast as possible (increment counter or set a flag)!
   - declare sleep_count as volatile variable for faster execution;
+  - the timeouts of TinySleep (LoRaWAN receive windows, sensor waits) are not sleep cycles;
 */
 ISR(WDT_vect) {
-  sleep_count++; // keep track of how many sleep cycles have been completed.
+  if (!TinySleep::sleeping()) {
+    sleep_count++; // keep track of how many sleep cycles have been completed.
+  }
 }
 
 
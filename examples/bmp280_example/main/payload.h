@@ -0,0 +1,17 @@
+/*
+  payload.h - uplink payload schema, shared with the host decoder (../decoder)
+*/
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include "BitPack.h"
+
+// 32 bits -> 4 bytes (7 bytes with two uint16_t x100 and 24 bit pressure x10)
+typedef BitPack<
+  BitField<0, 10000, 50, 100>,     // humidity: 0..100 %RH, 0.5 %RH (0.01 %RH units)
+  BitField<-2000, 6000, 10, 100>,  // temperature: -20..60 °C, 0.1 °C (0.01 °C units)
+  BitField<30000, 110000, 8, 100>  // pressure: 300..1100 hPa, 0.08 hPa (Pa)
+> Payload;
+
+#endif
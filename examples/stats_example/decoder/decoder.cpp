@@ -0,0 +1,39 @@
+/*
+  decoder.cpp - host decoder of the uplink payload, built from the same schema
+  as the node (../main/payload.h)
+
+  build: g++ -O2 -I../../../libs/BitPack -o decoder decoder.cpp
+  usage: echo <hex payload> | ./decoder
+         one payload per line, one CSV line per window (physical units):
+         count, temperature min, max, mean, std dev, humidity min, max, mean, std dev
+*/
+
+#include <stdio.h>
+#include <ctype.h>
+
+#include "../main/payload.h"
+
+int main() {
+  char line[520];
+  uint8_t buf[255];
+  int32_t values[Payload::fields];
+
+  while (fgets(line, sizeof(line), stdin)) {
+    unsigned len = 0;
+    for (char *p = line; isxdigit(p[0]) && isxdigit(p[1]) && len < sizeof(buf); p += 2) {
+      sscanf(p, "%2hhx", &buf[len++]);
+    }
+
+    if (len < Payload::bytes) {
+      continue;
+    }
+
+    Payload::unpack(buf, 0, values);
+    for (uint8_t i = 0; i < Payload::fields; i++) {
+      printf(i ? ",%g" : "%g", (double)values[i] / Payload::scale(i));
+    }
+    printf("\n");
+  }
+
+  return 0;
+}
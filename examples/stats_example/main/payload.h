@@ -0,0 +1,24 @@
+/*
+  payload.h - uplink payload schema, shared with the host decoder (../decoder)
+*/
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include "BitPack.h"
+
+// window statistics, 79 bits -> 10 bytes (one 3 byte sample every 8 s would
+// take 225 bytes over the same 10 minutes)
+typedef BitPack<
+  BitField<0, 255>,                // samples in the window
+  BitField<-2000, 6000, 10, 100>,  // temperature min: -20..60 °C, 0.1 °C (0.01 °C units)
+  BitField<-2000, 6000, 10, 100>,  // temperature max
+  BitField<-2000, 6000, 10, 100>,  // temperature mean
+  BitField<0, 1000, 1, 100>,       // temperature std dev: 0..10 °C, 0.01 °C
+  BitField<0, 10000, 50, 100>,     // humidity min: 0..100 %RH, 0.5 %RH (0.01 %RH units)
+  BitField<0, 10000, 50, 100>,     // humidity max
+  BitField<0, 10000, 50, 100>,     // humidity mean
+  BitField<0, 1000, 10, 100>       // humidity std dev: 0..10 %RH, 0.1 %RH
+> Payload;
+
+#endif
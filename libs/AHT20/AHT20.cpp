@@ -1,8 +1,18 @@
-#include "TinyWireM.h"
+#include "TinyI2C.h"
 
 #include <AHT20.h>
+#include <TinySleep.h>
 #include "Arduino.h"
 
+// Measurement: typically done in less than 80 ms. The MCU sleeps AHT20_FIRST_MS
+// (conversionTime), then polls the busy bit every AHT20_POLL_MS (sleeping in
+// between) for up to AHT20_TIMEOUT_MS; readData() triggers the measurement again
+// AHT20_RETRIES times.
+#define AHT20_FIRST_MS    40
+#define AHT20_POLL_MS     16
+#define AHT20_TIMEOUT_MS  150
+#define AHT20_RETRIES     1
+
 
 // construtor definition
 AHT20::AHT20(){
@@ -11,7 +21,18 @@ AHT20::AHT20(){
 
 // Start I2C and initialize AHT20
 bool AHT20::begin(){
-  TinyWireM.begin();
+  TinyI2C::acquire();
+  return initialize();
+}
+
+// Start I2C, initialize AHT20 only if needed (saves the 10 ms of initialize())
+bool AHT20::resume(){
+  TinyI2C::acquire();
+
+  // 0xFF: no answer
+  uint8_t status = readStatus();
+  if (status != 0xFF && (status & 0x08) != 0) return true;
+
   return initialize();
 }
 
@@ -21,23 +42,51 @@ bool AHT20::begin(){
  * and getHumidity() functions.
  */
 bool AHT20::readData(){
-  // Trigger measurement mode:
-  if(!triggerMeasurement()) return false;
+  for (uint8_t attempt = 0; attempt <= AHT20_RETRIES; attempt++) {
+    // Trigger measurement mode, sleep instead of delay(80) and read it as
+    // soon as the conversion is done:
+    if (!start()) continue;
+    TinySleep::wait(conversionTime());
+    if (collect()) return true;
+  }
+  return false;
+}
 
-  // read six bytes raw measurements:
-  uint8_t buff[6];
-  TinyWireM.requestFrom(AHT20_ADDRESS, 6);
+/* 
+ * Split phase measurement (see SensorGroup.h): start() triggers it,
+ * collect() reads it after conversionTime()
+ */
+bool AHT20::start(){
+  // Write measurement sequence {0xAC, 0x33, 0x00}
+  const uint8_t command[3] = { 0xAC, 0x33, 0x00 };
+  TinyI2C::acquire();
+  return TinyI2C::write(AHT20_ADDRESS, command, 3);
+}
+
+uint8_t AHT20::conversionTime(){
+  return AHT20_FIRST_MS;
+}
 
-  // check if all 6 bytes are ready:
-  if (TinyWireM.available() < 6) return false;
+bool AHT20::ready(){
+  // bit[7] = 0 indicates measurement completed:
+  return (readStatus() & 0x80) == 0;
+}
 
-  for (uint8_t i = 0; i < 6; i++) {
-    if (TinyWireM.available() > 0) {
-      buff[i] = TinyWireM.read();
-    }
+bool AHT20::collect(){
+  // not done after conversionTime(): poll, sleeping in between
+  for (uint16_t waited = AHT20_FIRST_MS; !ready(); waited += AHT20_POLL_MS) {
+    if (waited > AHT20_TIMEOUT_MS) return false;
+    TinySleep::wait(AHT20_POLL_MS);
   }
 
-  // ignore crc (byte7 not requested)
+  // read six bytes raw measurements and the CRC:
+  uint8_t buff[7];
+  TinyI2C::acquire();
+  if (!TinyI2C::read(AHT20_ADDRESS, buff, 7)) return false;
+
+  // drop corrupted samples
+  if (crc8(buff, 6) != buff[6]) return false;
+
   // ignore byte1 dedicated to status reg
 
   // Extract humidity and temperature values:
@@ -70,6 +119,21 @@ float AHT20::getTemperature(){
   return ((float)temperature_raw * 200/1048576) - 50;
 }
 
+/* 
+ * Same as getHumidity() with shifts and 32 bit multiplies only (no soft-float):
+ * raw * 10000 / 2^20 = raw * 625 / 2^16, rounded
+ */
+uint16_t AHT20::getHumidityCenti(){
+  return (humidity_raw * 625 + 32768) >> 16;
+}
+
+/* 
+ * Same as getTemperature() in 0.01 °C: raw * 20000 / 2^20 - 5000
+ */
+int16_t AHT20::getTemperatureCenti(){
+  return (int16_t)((temperature_raw * 625 + 16384) >> 15) - 5000;
+}
+
 /* 
  * Reset AH20 and close I2C interface
  */
@@ -78,9 +142,9 @@ void AHT20::reset(){
    * Avoid the subsequent instruction: by resetting the sensor 
    * the I2C resources are not correctly released
    */
-  TinyWireM.beginTransmission(AHT20_ADDRESS);
-  TinyWireM.write(0xBA);
-  TinyWireM.endTransmission();
+  const uint8_t command = 0xBA;
+  TinyI2C::acquire();
+  TinyI2C::write(AHT20_ADDRESS, &command, 1);
 
   // delay 20 ms to conclude reset process
   delay(20);
@@ -93,12 +157,9 @@ void AHT20::reset(){
   * Send initialization sequence:
   */
 bool AHT20::initialize(){
-  TinyWireM.beginTransmission(AHT20_ADDRESS);
   // Write initialization sequence {0xBE, 0x08, 0x00}
-  TinyWireM.write(0xBE); 
-  TinyWireM.write(0x08); 
-  TinyWireM.write(0x00); 
-  TinyWireM.endTransmission();
+  const uint8_t command[3] = { 0xBE, 0x08, 0x00 };
+  TinyI2C::write(AHT20_ADDRESS, command, 3);
 
   // wait 10ms as suggested in the datasheet
   delay(10);
@@ -120,37 +181,29 @@ bool AHT20::initialize(){
  * bit0:Remained
  */
 uint8_t AHT20::readStatus(){
-  TinyWireM.beginTransmission(AHT20_ADDRESS);
-  TinyWireM.write(0x71); // Contact status reg 0x71 
-  TinyWireM.endTransmission();
-
-  TinyWireM.requestFrom(AHT20_ADDRESS, 1);
+  const uint8_t command = 0x71; // Contact status reg 0x71 
   uint8_t status;
-  while(TinyWireM.available() > 0) {
-    status = TinyWireM.read();
+
+  TinyI2C::acquire();
+
+  // no answer: reported as busy
+  if (!TinyI2C::write(AHT20_ADDRESS, &command, 1) || !TinyI2C::read(AHT20_ADDRESS, &status, 1)) {
+    return 0xFF;
   }
 
   return status;
 }
 
-// Trigger measurment mode. If logic high is returned humidity and temperature
-// values can be read using the dedicated function
-bool AHT20::triggerMeasurement(){
-  TinyWireM.beginTransmission(AHT20_ADDRESS);
-  // Write measurement sequence {0xAC, 0x33, 0x00}
-  TinyWireM.write(0xAC); 
-  TinyWireM.write(0x33); 
-  TinyWireM.write(0x00); 
-  TinyWireM.endTransmission();
+// CRC-8 sent by the AHT20 after the measurement: x^8 + x^5 + x^4 + 1, init 0xFF
+uint8_t AHT20::crc8(const uint8_t *data, uint8_t len){
+  uint8_t crc = 0xFF;
 
-  // wait 80ms as suggested in the DS
-  delay(80);
+  for (uint8_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+  }
 
-  //verify measuremnt status:
-  uint8_t status = readStatus();
-  
-  // bit[7] = 0 indicates measurement completed:
-  if ((status & 0x80) == 0) return true;
-  return false;
+  return crc;
 }
-
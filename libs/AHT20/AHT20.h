@@ -1,7 +1,7 @@
 #ifndef AHT20_H
 #define AHT20_H
 
-#include <TinyWireM.h>  // Include TinyWireM for ATTINY I2C
+#include <TinyI2C.h>  // Include TinyI2C for ATTINY I2C (USI)
 
 class AHT20 {
   public:
@@ -13,13 +13,44 @@ class AHT20 {
     * @return Returns 1 when successful
     */
     bool begin();
+
+    /*!
+    * @brief Start I2C after a sleep cycle: the sensor stays calibrated while
+    *        powered, so it is initialized only if the calibration bit is clear
+    * @return Returns 1 when successful
+    */
+    bool resume();
     
     /*!
     * @brief Read humidity and temperature raw values
-    * @return Returns 1 if 6 bytes are correctly read
+    * @return Returns 1 if 7 bytes are correctly read and the CRC matches
     */
     bool readData();
 
+    /*!
+    * @brief Trigger a measurement, returns immediately (split phase, see SensorGroup.h)
+    * @return Returns 1 when successful
+    */
+    bool start();
+
+    /*!
+    * @brief Time to sleep between start() and collect()
+    * @return Returns the typical conversion time (ms)
+    */
+    uint8_t conversionTime();
+
+    /*!
+    * @brief Check the busy bit
+    * @return Returns 1 if the measurement is done
+    */
+    bool ready();
+
+    /*!
+    * @brief Wait for the end of the measurement (bounded) and read it
+    * @return Returns 1 if 7 bytes are correctly read and the CRC matches
+    */
+    bool collect();
+
     /*!
     * @brief Function to get temperature (in Celsius)
     * @return Returns temperature value (float, °C)
@@ -32,6 +63,18 @@ class AHT20 {
     */
     float getHumidity();
 
+    /*!
+    * @brief Function to get temperature without floating point
+    * @return Returns temperature value (0.01 °C)
+    */
+    int16_t getTemperatureCenti();
+
+    /*!
+    * @brief Function to get humidity without floating point
+    * @return Returns relative humidity value (0.01 %)
+    */
+    uint16_t getHumidityCenti();
+
     /*!
     * @brief Function to reset sensor and release I2C USI
     */
@@ -46,18 +89,18 @@ class AHT20 {
     */
     bool initialize();
 
-    /*!
-    * @brief Triggers humidity and temperature measurement
-    * @return Returns 1 when successful
-    */
-    bool triggerMeasurement();
-
     /*!
     * @brief Reads status reg (0x71)
     * @return Returns status reg byte
     */
     uint8_t readStatus();
 
+    /*!
+    * @brief CRC-8 of the measurement (polynomial 0x31, init 0xFF)
+    * @return Returns the CRC of len bytes
+    */
+    static uint8_t crc8(const uint8_t *data, uint8_t len);
+
     // Raw humidity and temperature
     uint32_t humidity_raw;
     uint32_t temperature_raw;
@@ -1,11 +1,16 @@
 // BMP280.cpp
 
+#include "Arduino.h"
+#include <avr/eeprom.h>
+
 #include "BMP280.h"
+#include <TinySleep.h>
 
 
 
 /* Constructor: initializes device address */
-BMP280::BMP280(const Settings& my_settings, uint8_t address) : m_settings(my_settings),  _address(address) {}
+BMP280::BMP280(const Settings& my_settings, uint8_t address) : m_settings(my_settings),  _address(address),
+  _calibrated(false), _cache(0xFFFF), _adc_T(0), _adc_P(0) {}
 
 /* 
     ############## PUBLIC FUNCTIONS ###############
@@ -15,8 +20,8 @@ BMP280::BMP280(const Settings& my_settings, uint8_t address) : m_settings(my_set
  * Initialize I2C bus, verify chip ID and readTrim data for calibration
  */
 bool BMP280::begin(){
-  // start I2C bus
-  TinyWireM.begin();
+  // take the I2C bus (the radio may have it)
+  TinyI2C::acquire();
 
   // verify chip ID
   bool stat = readChipID();
@@ -27,23 +32,47 @@ bool BMP280::begin(){
   // write settings defined in the Settings struct:
   WriteSettings();
 
+  _calibrated = stat;
+
   return stat;
 }
 
 
+/*
+ * Restart I2C only: the trim values never change and the settings are kept
+ * by the sensor while powered. After a reset of the MCU the calibration comes
+ * from the EEPROM copy (if any), otherwise begin() reads everything again
+ */
+bool BMP280::resume(){
+  TinyI2C::acquire();
+
+  if (_calibrated) return true;
+
+  if (loadCalibrationCache()) {
+    WriteSettings();
+    _calibrated = true;
+    return true;
+  }
+
+  return begin();
+}
+
+
+void BMP280::setCalibrationCache(uint16_t address){
+  _cache = address;
+}
+
+
 /*
  * use this function to read temeprature value
  * Argument can be either TempUnit_Celsius or TempUnit_Fahrenheit (see .h file)
  */
 float BMP280::readTemperature(TempUnit unit) {
-   int32_t data[SENSOR_DATA_LENGTH];
    int32_t t_fine;
 
-   if(!ReadData(data)){ return NAN; }
-
-   uint32_t rawTemp   = (data[3] << 12) | (data[4] << 4) | (data[5] >> 4);
+   if(!ReadData()){ return NAN; }
 
-   return CalculateTemperature(rawTemp, t_fine, unit);
+   return CalculateTemperature(_adc_T, t_fine, unit);
 }
 
 
@@ -59,17 +88,136 @@ float BMP280::readTemperature(TempUnit unit) {
  * PresUnit_psi
  */
 float BMP280::readPressure(PresUnit unit) {
-   int32_t data[SENSOR_DATA_LENGTH];
    int32_t t_fine;
 
-   if(!ReadData(data)){ return NAN; }
+   if(!ReadData()){ return NAN; }
+
+   CalculateTemperature(_adc_T, t_fine);
+
+   return CalculatePressure(_adc_P, t_fine, unit);
+}
+
 
-   uint32_t rawTemp       = (data[3] << 12) | (data[4] << 4) | (data[5] >> 4);
-   uint32_t rawPressure = (data[0] << 12) | (data[1] << 4) | (data[2] >> 4);
+/*
+ * use this function to read both values: one conversion, one 6 bytes burst,
+ * t_fine computed once. Integer results: 0.01 °C and Pa
+ */
+bool BMP280::readAll(int32_t& temp, uint32_t& press) {
+   if(!ReadData()){ return false; }
 
-   CalculateTemperature(rawTemp, t_fine);
+   temp  = getTemperatureCenti();
+   press = getPressure();
 
-   return CalculatePressure(rawPressure, t_fine, unit);
+   return true;
+}
+
+
+/*
+ * same as readAll with the 64 bit compensation: pressure in 0.1 Pa
+ */
+bool BMP280::readAllFine(int32_t& temp, uint32_t& press) {
+   if(!ReadData()){ return false; }
+
+   temp  = getTemperatureCenti();
+   press = getPressureFine();
+
+   return true;
+}
+
+
+/*
+ * Split phase measurement (see SensorGroup.h): start() triggers the forced
+ * conversion, collect() reads it after conversionTime(). In normal mode the
+ * data registers are updated continuously: start() does nothing.
+ */
+bool BMP280::start() {
+  if (m_settings.mode == Mode_Forced) {
+    // config is kept by the sensor: only ctrl_meas starts the conversion
+    uint8_t ctrlMeas, config;
+    CalculateRegisters(ctrlMeas, config);
+    writeRegister(CTRL_MEAS_ADDR, ctrlMeas);
+  }
+
+  return true;
+}
+
+
+/*
+ * Conversion done: status[3] (measuring) = 0
+ */
+bool BMP280::ready() {
+  uint8_t status;
+
+  if (m_settings.mode != Mode_Forced) return true;
+
+  return readRegister(STATUS_ADDR, &status, 1) && (status & STATUS_MEASURING) == 0;
+}
+
+
+/*
+ * Wait for the end of the conversion (1 ms polls, bounded), then read
+ * pressure and temperature in a single 6 bytes burst
+ */
+bool BMP280::collect() {
+  uint8_t buffer[SENSOR_DATA_LENGTH];
+
+  for (uint8_t polls = 0; !ready(); polls++) {
+    if (polls == STATUS_POLLS) return false;
+    TinySleep::idle(1);
+  }
+
+  // Registers are in order. So we can start at the pressure register and read 6 bytes.
+  if (!readRegister(PRESS_ADDR, buffer, SENSOR_DATA_LENGTH)) return false;
+
+  _adc_P = ((uint32_t)buffer[0] << 12) | ((uint32_t)buffer[1] << 4) | (buffer[2] >> 4);
+  _adc_T = ((uint32_t)buffer[3] << 12) | ((uint32_t)buffer[4] << 4) | (buffer[5] >> 4);
+
+  return true;
+}
+
+
+int32_t BMP280::getTemperatureCenti() {
+  int32_t t_fine;
+
+  return CompensateTemperature(_adc_T, t_fine);
+}
+
+
+uint32_t BMP280::getPressure() {
+  int32_t t_fine;
+
+  CompensateTemperature(_adc_T, t_fine);
+
+  return CompensatePressure(_adc_P, t_fine);
+}
+
+
+uint32_t BMP280::getPressureFine() {
+  int32_t t_fine;
+
+  CompensateTemperature(_adc_T, t_fine);
+
+  // Q24.8 Pa -> 0.1 Pa, rounded
+  return (CompensatePressure64(_adc_P, t_fine) * 10 + 128) >> 8;
+}
+
+
+/*
+ * Maximum measurement time (datasheet, appendix B):
+ * 1.25 ms + 2.3 ms * T oversampling + (2.3 ms * P oversampling + 0.575 ms)
+ * a skipped measurement (OSR = 0) takes no time
+ */
+uint8_t BMP280::conversionTime() {
+   uint32_t us = 1250;
+
+   if (m_settings.tempOSR) {
+     us += 2300UL << (m_settings.tempOSR - 1);
+   }
+   if (m_settings.presOSR) {
+     us += (2300UL << (m_settings.presOSR - 1)) + 575;
+   }
+
+   return (us + 999) / 1000;
 }
 
 /* 
@@ -126,6 +274,22 @@ bool BMP280::readCalibrationData(){
 
   stat &= readRegister(PRESS_DIG_ADDR, &m_dig[TEMP_DIG_LENGTH], PRESS_DIG_LENGTH);
 
+  setCalibrationData(m_dig);
+
+  // keep a copy for resume() after a reset
+  if (stat && _cache != 0xFFFF) {
+    eeprom_update_block(m_dig, (void *)(uintptr_t)_cache, DIG_LENGTH);
+    eeprom_update_byte((uint8_t *)(uintptr_t)(_cache + DIG_LENGTH), CalibrationChecksum(m_dig));
+  }
+
+  return stat;
+}
+
+
+/*
+ * Calibration coefficients from the trim registers (0x88-0x9F, little endian)
+ */
+void BMP280::setCalibrationData(const uint8_t m_dig[DIG_LENGTH]){
   // set calibration coefficients:
   dig_T1 = (m_dig[1] << 8) | m_dig[0];
   dig_T2 = (m_dig[3] << 8) | m_dig[2];
@@ -140,8 +304,36 @@ bool BMP280::readCalibrationData(){
   dig_P7 = (m_dig[19] << 8) | m_dig[18];
   dig_P8 = (m_dig[21] << 8) | m_dig[20];
   dig_P9 = (m_dig[23] << 8) | m_dig[22];
+}
 
-  return stat;
+
+/*
+ * Calibration data from the EEPROM copy written by begin()
+ */
+bool BMP280::loadCalibrationCache(){
+  uint8_t m_dig[DIG_LENGTH];
+
+  if (_cache == 0xFFFF) return false;
+
+  eeprom_read_block(m_dig, (void *)(uintptr_t)_cache, DIG_LENGTH);
+  if (eeprom_read_byte((uint8_t *)(uintptr_t)(_cache + DIG_LENGTH)) != CalibrationChecksum(m_dig)) {
+    return false;
+  }
+
+  setCalibrationData(m_dig);
+
+  return true;
+}
+
+
+uint8_t BMP280::CalibrationChecksum(const uint8_t m_dig[DIG_LENGTH]){
+  uint8_t sum = 0x5A;
+
+  for (uint8_t i = 0; i < DIG_LENGTH; i++) {
+    sum = (sum << 1 | sum >> 7) + m_dig[i];
+  }
+
+  return sum;
 }
 
 
@@ -150,24 +342,67 @@ bool BMP280::readCalibrationData(){
  * described on the BMP280 datasheet 
  */
 float BMP280::CalculateTemperature(int32_t raw, int32_t& t_fine, TempUnit unit) {
+  int32_t final = CompensateTemperature(raw, t_fine);
+
+  return unit == TempUnit_Celsius ? final/100.0 : final/100.0*9.0/5.0 + 32.0;
+}
+
+
+/*
+ * Returns pressure compensated using the procedure described in the DS
+ */
+float BMP280::CalculatePressure(int32_t adc_P, int32_t t_fine, PresUnit unit) {
+  float p = CompensatePressure(adc_P, t_fine);
+
+  // Conversion units courtesy of www.endmemo.com.
+  switch(unit){
+    case PresUnit_hPa: /* hPa */
+        p /= 100.0;
+        break;
+    case PresUnit_inHg: /* inHg */
+        p /= 3386.3752577878;          /* p pa * 1inHg/3386.3752577878Pa */
+        break;
+    case PresUnit_atm: /* atm */
+        p /= 101324.99766353;          /* p pa * 1 atm/101324.99766353Pa */
+        break;
+    case PresUnit_bar: /* bar */
+        p /= 100000.0;                 /* p pa * 1 bar/100kPa */
+        break;
+    case PresUnit_torr: /* torr */
+        p /= 133.32236534674;           /* p pa * 1 torr/133.32236534674Pa */
+        break;
+    case PresUnit_psi: /* psi */
+        p /= 6894.744825494;            /* p pa * 1psi/6894.744825494Pa */
+        break;
+    default: /* Pa (case: 0) */
+        break;
+  }
+  
+  return p;
+}
+
+
+/*
+ * Temperature in 0.01 °C from the raw value and the calibration process
+ * described on the BMP280 datasheet
+ */
+int32_t BMP280::CompensateTemperature(int32_t raw, int32_t& t_fine) {
   // Code based on calibration algorthim provided by Bosch.
-  int32_t var1, var2, final;
+  int32_t var1, var2;
  
   var1 = ((((raw >> 3) - ((int32_t)dig_T1 << 1))) * ((int32_t)dig_T2)) >> 11;
   var2 = (((((raw >> 4) - ((int32_t)dig_T1)) * ((raw >> 4) - ((int32_t)dig_T1))) >> 12) * ((int32_t)dig_T3)) >> 14;
 
   t_fine = var1 + var2;
 
-  final = (t_fine * 5 + 128) >> 8;
-
-  return unit == TempUnit_Celsius ? final/100.0 : final/100.0*9.0/5.0 + 32.0;
+  return (t_fine * 5 + 128) >> 8;
 }
 
 
 /*
- * Returns pressure compensated using the procedure described in the DS
+ * Pressure in Pa, 32 bit integer procedure described in the DS
  */
-float BMP280::CalculatePressure(int32_t adc_P, int32_t t_fine, PresUnit unit) {
+uint32_t BMP280::CompensatePressure(int32_t adc_P, int32_t t_fine) {
   typedef int32_t BMP280_S32_t;  // 32-bit signed integer
   typedef uint32_t BMP280_U32_t;  // 32-bit unsigned integer
 
@@ -198,56 +433,52 @@ float BMP280::CalculatePressure(int32_t adc_P, int32_t t_fine, PresUnit unit) {
 
   p = (BMP280_U32_t)((BMP280_S32_t)p + ((var1 + var2 + dig_P7) >> 4));
 
-  // Conversion units courtesy of www.endmemo.com.
-  switch(unit){
-    case PresUnit_hPa: /* hPa */
-        p /= 100.0;
-        break;
-    case PresUnit_inHg: /* inHg */
-        p /= 3386.3752577878;          /* p pa * 1inHg/3386.3752577878Pa */
-        break;
-    case PresUnit_atm: /* atm */
-        p /= 101324.99766353;          /* p pa * 1 atm/101324.99766353Pa */
-        break;
-    case PresUnit_bar: /* bar */
-        p /= 100000.0;                 /* p pa * 1 bar/100kPa */
-        break;
-    case PresUnit_torr: /* torr */
-        p /= 133.32236534674;           /* p pa * 1 torr/133.32236534674Pa */
-        break;
-    case PresUnit_psi: /* psi */
-        p /= 6894.744825494;            /* p pa * 1psi/6894.744825494Pa */
-        break;
-    default: /* Pa (case: 0) */
-        break;
-  }
-  
   return p;
 }
 
 
 /*
- * Read raw teperature and pressure values in a single operation
- * starting from pressure data register
+ * Pressure in Pa (Q24.8), 64 bit integer procedure described in the DS
  */
-bool BMP280::ReadData(int32_t data[SENSOR_DATA_LENGTH])
-{
-  bool status;
-  uint8_t buffer[SENSOR_DATA_LENGTH];
+uint32_t BMP280::CompensatePressure64(int32_t adc_P, int32_t t_fine) {
+  typedef int64_t BMP280_S64_t;  // 64-bit signed integer
 
-  // For forced mode we need to write the mode to BMP280 register before reading
-  if (m_settings.mode == Mode_Forced) {
-    WriteSettings();
+  BMP280_S64_t var1, var2, p;
+
+  var1 = ((BMP280_S64_t)t_fine) - 128000;
+  var2 = var1 * var1 * (BMP280_S64_t)dig_P6;
+  var2 = var2 + ((var1*(BMP280_S64_t)dig_P5)<<17);
+  var2 = var2 + (((BMP280_S64_t)dig_P4)<<35);
+  var1 = ((var1 * var1 * (BMP280_S64_t)dig_P3)>>8) + ((var1 * (BMP280_S64_t)dig_P2)<<12);
+  var1 = (((((BMP280_S64_t)1)<<47)+var1))*((BMP280_S64_t)dig_P1)>>33;
+
+  if (var1 == 0) {
+    return 0; // avoid exception caused by division by zero
   }
 
-  // Registers are in order. So we can start at the pressure register and read 6 bytes.
-  status = readRegister(PRESS_ADDR, buffer, SENSOR_DATA_LENGTH);
+  p = 1048576-adc_P;
+  p = (((p<<31)-var2)*3125)/var1;
+  var1 = (((BMP280_S64_t)dig_P9) * (p>>13) * (p>>13)) >> 25;
+  var2 = (((BMP280_S64_t)dig_P8) * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + (((BMP280_S64_t)dig_P7)<<4);
+
+  return (uint32_t)p;
+}
+
+
+/*
+ * Blocking measurement: start the conversion, sleep until it is due, then
+ * collect the raw teperature and pressure values in a single operation
+ */
+bool BMP280::ReadData()
+{
+  if (!start()) return false;
 
-  for(int i = 0; i < SENSOR_DATA_LENGTH; ++i) {
-    data[i] = static_cast<int32_t>(buffer[i]);
+  if (m_settings.mode == Mode_Forced) {
+    TinySleep::wait(conversionTime());
   }
 
-  return status;
+  return collect();
 }
 
 
@@ -258,22 +489,9 @@ bool BMP280::ReadData(int32_t data[SENSOR_DATA_LENGTH])
  * until the specified number of bytes has been transmitted
  */
 bool BMP280::readRegister(uint8_t reg, uint8_t *buff, uint8_t length){
-  // Write to register  
-  TinyWireM.beginTransmission(_address);
-  TinyWireM.write(reg);
-  TinyWireM.endTransmission();
-
-  // request bytes:
-  TinyWireM.requestFrom(_address, length);
-
-  if(TinyWireM.available() < length) return false;
-
-  uint8_t idx = 0;
-  while(TinyWireM.available() > 0) {
-    buff[idx++] = TinyWireM.read();
-  }
-
-  return idx == length;
+  // Write to register, then read straight into buff after a repeated start
+  TinyI2C::acquire();
+  return TinyI2C::readRegister(_address, reg, buff, length);
 }
 
 
@@ -284,8 +502,6 @@ bool BMP280::readRegister(uint8_t reg, uint8_t *buff, uint8_t length){
  * until the specified number of bytes has been transmitted
  */
 void BMP280::writeRegister(uint8_t reg, uint8_t value){
-  TinyWireM.beginTransmission(_address);
-  TinyWireM.write(reg);
-  TinyWireM.write(value);
-  TinyWireM.endTransmission();
+  TinyI2C::acquire();
+  TinyI2C::writeRegister(_address, reg, value);
 }
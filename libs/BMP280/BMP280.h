@@ -3,7 +3,7 @@
 #ifndef BMP280_H
 #define BMP280_H
 
-#include <TinyWireM.h>  // For ATtiny I2C communication
+#include <TinyI2C.h>  // For ATtiny I2C communication (USI)
 #include <stdint.h>
 
 class BMP280 {
@@ -129,6 +129,20 @@ public:
     */
     bool begin();
 
+    /*!
+    * @brief Start I2C after a sleep cycle: the calibration data is kept in RAM
+    *        (or restored from EEPROM after a reset, see setCalibrationCache),
+    *        begin() runs only if none is available
+    * @return Returns 1 when successful
+    */
+    bool resume();
+
+    /*!
+    * @brief Keep a copy of the calibration data in EEPROM (25 bytes with checksum)
+    * @param address first EEPROM byte
+    */
+    void setCalibrationCache(uint16_t address);
+
 
     /*****************************************************************/
     /* ENVIRONMENTAL FUNCTIONS                                       */
@@ -146,6 +160,70 @@ public:
     */
     float readPressure(PresUnit unit);
 
+    /*!
+    * @brief Read temperature and pressure from a single conversion and burst read
+    * @param temp temperature (0.01 °C)
+    * @param press pressure (Pa)
+    * @return 1 if sucessfull
+    */
+    bool readAll(int32_t& temp, uint32_t& press);
+
+    /*!
+    * @brief Same as readAll, pressure from the Bosch 64 bit compensation (0.16 Pa
+    *        resolution): larger and slower on AVR than the 32 bit one
+    * @param temp temperature (0.01 °C)
+    * @param press pressure (0.1 Pa)
+    * @return 1 if sucessfull
+    */
+    bool readAllFine(int32_t& temp, uint32_t& press);
+
+    /*!
+    * @brief Maximum forced mode conversion time for the OSR settings (datasheet)
+    * @return conversion time (ms, rounded up)
+    */
+    uint8_t conversionTime();
+
+
+    /*****************************************************************/
+    /* SPLIT PHASE FUNCTIONS (see SensorGroup.h)                     */
+    /*****************************************************************/
+
+    /*!
+    * @brief Start a conversion (forced mode), returns immediately
+    * @return 1 if sucessfull
+    */
+    bool start();
+
+    /*!
+    * @brief Check if the conversion is done (status register)
+    * @return 1 if the data can be collected
+    */
+    bool ready();
+
+    /*!
+    * @brief Wait for the end of the conversion (bounded) and read the raw data
+    * @return 1 if sucessfull
+    */
+    bool collect();
+
+    /*!
+    * @brief Collected temperature
+    * @return temperature (0.01 °C)
+    */
+    int32_t getTemperatureCenti();
+
+    /*!
+    * @brief Collected pressure, 32 bit compensation
+    * @return pressure (Pa)
+    */
+    uint32_t getPressure();
+
+    /*!
+    * @brief Collected pressure, 64 bit compensation
+    * @return pressure (0.1 Pa)
+    */
+    uint32_t getPressureFine();
+
 private:
 
     /*****************************************************************/
@@ -154,6 +232,7 @@ private:
 
     static const uint8_t CHIP_MODEL = 0x58;
 
+    static const uint8_t STATUS_ADDR    = 0xF3;
     static const uint8_t CTRL_MEAS_ADDR = 0xF4;
     static const uint8_t CONFIG_ADDR    = 0xF5;
     static const uint8_t PRESS_ADDR     = 0xF7;
@@ -167,6 +246,9 @@ private:
     static const uint8_t DIG_LENGTH         = 24;
     static const uint8_t SENSOR_DATA_LENGTH = 6;
 
+    static const uint8_t STATUS_MEASURING = 0x08;  // status[3]: conversion running
+    static const uint8_t STATUS_POLLS     = 10;    // 1 ms polls after conversionTime()
+
 
     /*****************************************************************/
     /* VARIABLES                                                     */
@@ -176,6 +258,13 @@ private:
 
     uint8_t _address;    // specify your device address according to SDO connection
 
+    bool _calibrated;    // calibration data loaded
+    uint16_t _cache;     // EEPROM copy of the calibration data (0xFFFF = none)
+
+    // raw temperature and pressure of the last conversion collected
+    int32_t _adc_T;
+    int32_t _adc_P;
+
     // Calibration parameters
     uint16_t dig_T1;
     int16_t dig_T2, dig_T3;
@@ -210,6 +299,24 @@ private:
     */
     bool readCalibrationData();
 
+    /*!
+    * @brief Set the calibration coefficients from the trim registers bytes
+    * @return void
+    */
+    void setCalibrationData(const uint8_t m_dig[DIG_LENGTH]);
+
+    /*!
+    * @brief Read the calibration data from the EEPROM copy
+    * @return 1 if the checksum matches
+    */
+    bool loadCalibrationCache();
+
+    /*!
+    * @brief Checksum of the EEPROM copy of the calibration data
+    * @return checksum byte
+    */
+    static uint8_t CalibrationChecksum(const uint8_t m_dig[DIG_LENGTH]);
+
     /*!
     * @brief Return final temperature value based on the BMP calibration process
     * @return float correpsonding to the measured temperature
@@ -223,10 +330,28 @@ private:
     float CalculatePressure(int32_t adc_P, int32_t t_fine, PresUnit unit);
 
     /*!
-    * @brief Read raw temperature and pressure values:
+    * @brief Integer temperature compensation (Bosch), also sets t_fine
+    * @return temperature (0.01 °C)
+    */
+    int32_t CompensateTemperature(int32_t raw, int32_t& t_fine);
+
+    /*!
+    * @brief Integer pressure compensation (Bosch, 32 bit)
+    * @return pressure (Pa), 0 if the calibration data is invalid
+    */
+    uint32_t CompensatePressure(int32_t adc_P, int32_t t_fine);
+
+    /*!
+    * @brief Integer pressure compensation (Bosch, 64 bit)
+    * @return pressure (Pa, Q24.8), 0 if the calibration data is invalid
+    */
+    uint32_t CompensatePressure64(int32_t adc_P, int32_t t_fine);
+
+    /*!
+    * @brief Read raw temperature and pressure values (start, sleep, collect):
     * @return 1 if sucessfull
     */
-    bool ReadData(int32_t data[SENSOR_DATA_LENGTH]);
+    bool ReadData();
 
     /*!
     * @brief Read the specified amount of bytes from register "reg"
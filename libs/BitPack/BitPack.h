@@ -0,0 +1,153 @@
+#ifndef BITPACK_H
+#define BITPACK_H
+
+#include <stdint.h>
+
+/*
+ * Compile-time payload schema: each field is packed in the minimum number of
+ * bits that holds its range at the requested resolution, MSB first, with no
+ * byte alignment between fields.
+ *
+ * Values are integers in the units chosen by the sketch (e.g. 0.01 °C):
+ *
+ *   typedef BitPack<
+ *     BitField<-2000, 6000, 10, 100>,  // temperature -20..60 °C, 0.1 °C
+ *     BitField<0, 10000, 50, 100>      // humidity 0..100 %RH, 0.5 %RH
+ *   > Payload;
+ *
+ *   uint8_t Data[Payload::bytes];
+ *   Payload::pack(Data, 0, temp, hum);
+ *
+ * Header only and free of Arduino dependencies: the same schema header is
+ * compiled into the host decoder of each example.
+ */
+
+/*!
+* @brief Bit level access to a byte buffer (bit 0 is the MSB of byte 0)
+*/
+struct BitStream {
+  static void write(uint8_t *buf, uint16_t offset, uint8_t width, uint32_t value) {
+    uint32_t bit = width ? 1UL << (width - 1) : 0;
+    for (; bit; bit >>= 1, offset++) {
+      uint8_t mask = 0x80 >> (offset & 0x07);
+      if (value & bit) {
+        buf[offset >> 3] |= mask;
+      } else {
+        buf[offset >> 3] &= ~mask;
+      }
+    }
+  }
+
+  static uint32_t read(const uint8_t *buf, uint16_t offset, uint8_t width) {
+    uint32_t value = 0;
+    for (; width; width--, offset++) {
+      value = (value << 1) | ((buf[offset >> 3] >> (7 - (offset & 0x07))) & 0x01);
+    }
+    return value;
+  }
+
+  // number of bits needed to store 0..n
+  static constexpr uint8_t bitsFor(uint32_t n) {
+    return n ? 1 + bitsFor(n >> 1) : 0;
+  }
+};
+
+
+/*!
+* @brief Field of a schema
+* @param Min lowest value (sketch units)
+* @param Max highest value (sketch units)
+* @param Step resolution (sketch units), values are rounded to it
+* @param Scale sketch units per physical unit, used by the host decoder only
+*/
+template <int32_t Min, int32_t Max, int32_t Step = 1, int32_t Scale = 1>
+struct BitField {
+  static constexpr uint32_t levels = (uint32_t)(Max - Min) / Step;
+  static constexpr uint8_t bits = BitStream::bitsFor(levels);
+  static constexpr int32_t scale = Scale;
+
+  static_assert(Max > Min && Step > 0, "BitField: empty range");
+  static_assert(bits <= 32, "BitField: too wide");
+
+  // out of range values are clamped; levels is the highest code: a value
+  // near Max may round up past it when Step does not divide Max - Min
+  static uint32_t encode(int32_t value) {
+    if (value <= Min) return 0;
+    uint32_t code = ((uint32_t)(value - Min) + Step / 2) / Step;
+    return code > levels ? levels : code;
+  }
+
+  static int32_t decode(uint32_t code) {
+    return Min + (int32_t)code * Step;
+  }
+};
+
+
+// one int32_t argument per field
+template <typename F>
+using BitValue = int32_t;
+
+template <typename... Fields>
+struct BitPack;
+
+template <>
+struct BitPack<> {
+  static constexpr uint16_t bits = 0;
+
+  static uint16_t pack(uint8_t *, uint16_t offset) {
+    return offset;
+  }
+
+  static uint16_t unpack(const uint8_t *, uint16_t offset, int32_t *) {
+    return offset;
+  }
+
+  static int32_t scale(uint8_t) {
+    return 1;
+  }
+
+  static uint8_t width(uint8_t) {
+    return 0;
+  }
+};
+
+template <typename F, typename... Rest>
+struct BitPack<F, Rest...> {
+  // payload size of one record
+  static constexpr uint16_t bits = F::bits + BitPack<Rest...>::bits;
+  static constexpr uint8_t bytes = (bits + 7) / 8;
+  static constexpr uint8_t fields = 1 + sizeof...(Rest);
+
+  /*!
+  * @brief Pack one record at a bit offset (records can be appended back to back)
+  * @param buf payload buffer
+  * @param offset first bit to write
+  * @return Returns the bit offset after the record
+  */
+  static uint16_t pack(uint8_t *buf, uint16_t offset, int32_t value, BitValue<Rest>... rest) {
+    BitStream::write(buf, offset, F::bits, F::encode(value));
+    return BitPack<Rest...>::pack(buf, offset + F::bits, rest...);
+  }
+
+  /*!
+  * @brief Unpack one record from a bit offset
+  * @param values output, one value per field (sketch units)
+  * @return Returns the bit offset after the record
+  */
+  static uint16_t unpack(const uint8_t *buf, uint16_t offset, int32_t *values) {
+    values[0] = F::decode(BitStream::read(buf, offset, F::bits));
+    return BitPack<Rest...>::unpack(buf, offset + F::bits, values + 1);
+  }
+
+  // sketch units per physical unit of field index
+  static int32_t scale(uint8_t index) {
+    return index ? BitPack<Rest...>::scale(index - 1) : F::scale;
+  }
+
+  // bits of field index
+  static uint8_t width(uint8_t index) {
+    return index ? BitPack<Rest...>::width(index - 1) : F::bits;
+  }
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef DELTACODEC_H
+#define DELTACODEC_H
+
+#include <stdint.h>
+#include "BitPack.h"
+
+/*
+ * Delta coding of a batch of records of a BitPack schema: consecutive
+ * readings differ by a few steps, so after the first record (absolute) each
+ * field is sent as zig-zag deltas of its codes, all in the smallest width
+ * that holds the largest delta of the batch (0 bits if the field did not
+ * move at all).
+ *
+ *   [1][count-1 : 6][record 0 : Schema::bits]
+ *   for each field: [width : 5][count-1 deltas : width bits each]
+ *
+ * If that is not shorter, the batch is sent as plain records after a 0 bit:
+ * a batch never takes more than one bit over the plain records.
+ *
+ *   uint8_t Data[DeltaCodec<Payload>::maxBytes(8)];
+ *   Data_Length = DeltaCodec<Payload>::encode(Data, records, 0, count, count);
+ *
+ * decode() rebuilds the records on the host (see the decoder of the examples).
+ */
+template <typename Schema>
+struct DeltaCodec {
+  static constexpr uint8_t maxRecords = 64;
+
+  // payload size of count records in the worst case
+  static constexpr uint8_t maxBytes(uint8_t count) {
+    return (1 + (uint16_t)Schema::bits * count + 7) / 8;
+  }
+
+  /*!
+  * @brief Encode records packed back to back in a ring
+  * @param out payload buffer (maxBytes(count)), not overlapping the records
+  * @param records packed records, record i at ((first + i) % slots) * Schema::bits
+  * @param count number of records (oldest first)
+  * @return Returns the payload length (bytes)
+  */
+  static uint8_t encode(uint8_t *out, const uint8_t *records, uint8_t first, uint8_t count, uint8_t slots) {
+    uint8_t width[Schema::fields];
+    uint16_t bits = 7 + Schema::bits;
+    uint16_t offset = 0;
+    bool plain = count < 2 || count > maxRecords;
+
+    for (uint8_t f = 0; f < Schema::fields && !plain; f++) {
+      uint32_t largest = 0;
+      for (uint8_t i = 1; i < count; i++) {
+        uint32_t delta = zigzag(code(records, (first + i) % slots, f) - code(records, (first + i - 1) % slots, f));
+        largest |= delta;
+      }
+      width[f] = BitStream::bitsFor(largest);
+      bits += 5 + (uint16_t)width[f] * (count - 1);
+      plain = width[f] > 31;
+    }
+
+    if (plain || bits >= 1 + (uint16_t)Schema::bits * count) {
+      // plain records
+      BitStream::write(out, offset++, 1, 0);
+      for (uint8_t i = 0; i < count; i++) {
+        offset = copy(out, offset, records, record((first + i) % slots));
+      }
+    } else {
+      BitStream::write(out, offset, 1, 1);
+      BitStream::write(out, offset + 1, 6, count - 1);
+      offset = copy(out, offset + 7, records, record(first));
+
+      for (uint8_t f = 0; f < Schema::fields; f++) {
+        BitStream::write(out, offset, 5, width[f]);
+        offset += 5;
+        for (uint8_t i = 1; i < count; i++) {
+          BitStream::write(out, offset, width[f], zigzag(code(records, (first + i) % slots, f) - code(records, (first + i - 1) % slots, f)));
+          offset += width[f];
+        }
+      }
+    }
+
+    // clear the padding bits
+    if (offset & 0x07) {
+      BitStream::write(out, offset, 8 - (offset & 0x07), 0);
+    }
+
+    return (offset + 7) / 8;
+  }
+
+  /*!
+  * @brief Decode a payload (host side)
+  * @param values output, Schema::fields values per record (sketch units)
+  * @param max capacity of values (records)
+  * @return Returns the number of records
+  */
+  static uint8_t decode(const uint8_t *in, uint8_t len, int32_t *values, uint8_t max) {
+    uint8_t record[Schema::bytes];
+    uint32_t last[Schema::fields];
+    uint16_t offset = 1;
+    uint8_t count;
+
+    if (len == 0) {
+      return 0;
+    }
+
+    if (!BitStream::read(in, 0, 1)) {
+      // plain records
+      for (count = 0; count < max && offset + Schema::bits <= (uint16_t)len * 8; count++) {
+        offset = Schema::unpack(in, offset, values + (uint16_t)count * Schema::fields);
+      }
+      return count;
+    }
+
+    count = BitStream::read(in, 1, 6) + 1;
+    if (count > max || 7 + Schema::bits > (uint16_t)len * 8) {
+      return 0;
+    }
+    offset = 7;
+    for (uint8_t f = 0; f < Schema::fields; f++) {
+      last[f] = BitStream::read(in, offset, Schema::width(f));
+      offset += Schema::width(f);
+    }
+
+    // one column (field) at a time: rebuild the codes, then the values
+    uint32_t codes[maxRecords][Schema::fields];
+    for (uint8_t f = 0; f < Schema::fields; f++) {
+      uint8_t width = BitStream::read(in, offset, 5);
+      offset += 5;
+      codes[0][f] = last[f];
+      for (uint8_t i = 1; i < count; i++) {
+        if (offset + width > (uint16_t)len * 8) {
+          return 0;
+        }
+        codes[i][f] = codes[i - 1][f] + unzigzag(BitStream::read(in, offset, width));
+        offset += width;
+      }
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+      uint16_t bit = 0;
+      for (uint8_t f = 0; f < Schema::fields; f++) {
+        BitStream::write(record, bit, Schema::width(f), codes[i][f]);
+        bit += Schema::width(f);
+      }
+      Schema::unpack(record, 0, values + (uint16_t)i * Schema::fields);
+    }
+
+    return count;
+  }
+
+  private:
+    static uint16_t record(uint8_t index) {
+      return (uint16_t)index * Schema::bits;
+    }
+
+    // code of field f of a record
+    static uint32_t code(const uint8_t *records, uint8_t index, uint8_t f) {
+      uint16_t offset = record(index);
+      for (uint8_t i = 0; i < f; i++) {
+        offset += Schema::width(i);
+      }
+      return BitStream::read(records, offset, Schema::width(f));
+    }
+
+    // copy a record 16 bits at a time
+    static uint16_t copy(uint8_t *out, uint16_t offset, const uint8_t *records, uint16_t in) {
+      for (uint16_t n = 0; n < Schema::bits; n += 16) {
+        uint8_t width = Schema::bits - n < 16 ? Schema::bits - n : 16;
+        BitStream::write(out, offset + n, width, BitStream::read(records, in + n, width));
+      }
+      return offset + Schema::bits;
+    }
+
+    // 0, -1, 1, -2, 2... -> 0, 1, 2, 3, 4...
+    static uint32_t zigzag(uint32_t delta) {
+      return (delta << 1) ^ (uint32_t)-(int32_t)(delta >> 31);
+    }
+
+    static uint32_t unzigzag(uint32_t value) {
+      return (value >> 1) ^ (uint32_t)-(int32_t)(value & 0x01);
+    }
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "Arduino.h"
+#include <avr/eeprom.h>
+
+#include "EepromLog.h"
+
+// sequence of a free slot (erased EEPROM)
+#define FREE 0xFF
+
+EepromLog::EepromLog(uint16_t address, uint16_t size, uint8_t record_length) {
+  _address = address;
+  _length = record_length;
+  _slots = size / (record_length + 3) > 254 ? 254 : size / (record_length + 3);
+  _tail = 0;
+  _count = 0;
+  _sequence = 0;
+}
+
+
+/*
+ * The stored records are a run of consecutive sequence numbers: the newest
+ * one is the record not followed by its next sequence number.
+ */
+void EepromLog::begin() {
+  uint8_t newest = 0;
+  uint8_t sequence;
+
+  _tail = 0;
+  _count = 0;
+  _sequence = 0;
+
+  for (uint8_t i = 0; i < _slots; i++) {
+    sequence = eeprom_read_byte((uint8_t *)(uintptr_t)slotAddress(i));
+    if (sequence == FREE) continue;
+
+    _count++;
+    if (eeprom_read_byte((uint8_t *)(uintptr_t)slotAddress((i + 1) % _slots)) != nextSequence(sequence)) {
+      newest = i;
+      _sequence = nextSequence(sequence);
+    }
+  }
+
+  if (_count > 0) {
+    _tail = (newest + _slots + 1 - _count) % _slots;
+  }
+}
+
+
+void EepromLog::push(uint16_t timestamp, const uint8_t *record) {
+  uint8_t slot = (_tail + _count) % _slots;
+  uint16_t address = slotAddress(slot);
+
+  // full: the oldest record is overwritten
+  if (_count == _slots) {
+    _tail = (_tail + 1) % _slots;
+    _count--;
+  }
+
+  // invalidate - write - commit
+  eeprom_update_byte((uint8_t *)(uintptr_t)address, FREE);
+  eeprom_update_word((uint16_t *)(uintptr_t)(address + 1), timestamp);
+  eeprom_update_block(record, (void *)(uintptr_t)(address + 3), _length);
+  eeprom_update_byte((uint8_t *)(uintptr_t)address, _sequence);
+
+  _sequence = nextSequence(_sequence);
+  _count++;
+}
+
+
+bool EepromLog::peek(uint8_t index, uint16_t &timestamp, uint8_t *record) {
+  if (index >= _count) {
+    return false;
+  }
+
+  uint16_t address = slotAddress((_tail + index) % _slots);
+  timestamp = eeprom_read_word((uint16_t *)(uintptr_t)(address + 1));
+  eeprom_read_block(record, (void *)(uintptr_t)(address + 3), _length);
+
+  return true;
+}
+
+
+void EepromLog::pop(uint8_t n) {
+  for (; n > 0 && _count > 0; n--) {
+    eeprom_update_byte((uint8_t *)(uintptr_t)slotAddress(_tail), FREE);
+    _tail = (_tail + 1) % _slots;
+    _count--;
+  }
+}
+
+
+uint8_t EepromLog::count() {
+  return _count;
+}
+
+
+/* ############### PRIVATE FUNCTIONS ################## */
+
+uint16_t EepromLog::slotAddress(uint8_t slot) {
+  return _address + (uint16_t)slot * (_length + 3);
+}
+
+
+uint8_t EepromLog::nextSequence(uint8_t sequence) {
+  return sequence >= 254 ? 0 : sequence + 1;
+}
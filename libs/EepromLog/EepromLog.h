@@ -0,0 +1,70 @@
+#ifndef EEPROMLOG_H
+#define EEPROMLOG_H
+
+#include <stdint.h>
+
+/*
+ * Store-and-forward log of fixed size records in EEPROM, for the readings
+ * that could not be sent (duty cycle, no ACK...): drained oldest first when
+ * the link is available again.
+ *
+ * Each slot is [sequence][timestamp (2)][record]. A record is written as
+ * invalidate (sequence = 0xFF) - write - commit (sequence), so a reset in
+ * the middle of a write only loses that record, and sent records are dropped
+ * with a single byte write. Consecutive records have consecutive sequence
+ * numbers (0-254): begin() rebuilds head and tail from them after a reset.
+ * When the log is full the oldest record is overwritten.
+ *
+ * Timestamps are in the unit chosen by the sketch (e.g. 8 s watchdog ticks
+ * since boot), 16 bit wrapping.
+ */
+class EepromLog {
+  public:
+    /*!
+    * @brief Constructor
+    * @param address first EEPROM byte of the log
+    * @param size EEPROM bytes used by the log
+    * @param record_length bytes per record
+    */
+    EepromLog(uint16_t address, uint16_t size, uint8_t record_length);
+
+    /*!
+    * @brief Find the stored records (call once in setup)
+    */
+    void begin();
+
+    /*!
+    * @brief Append a record
+    * @param timestamp time of the reading
+    * @param record record_length bytes
+    */
+    void push(uint16_t timestamp, const uint8_t *record);
+
+    /*!
+    * @brief Read a stored record
+    * @param index 0 = oldest
+    * @return Returns false if index >= count()
+    */
+    bool peek(uint8_t index, uint16_t &timestamp, uint8_t *record);
+
+    /*!
+    * @brief Drop the n oldest records (after they were sent)
+    */
+    void pop(uint8_t n);
+
+    // number of stored records
+    uint8_t count();
+
+  private:
+    uint16_t slotAddress(uint8_t slot);
+    static uint8_t nextSequence(uint8_t sequence);
+
+    uint16_t _address;
+    uint8_t _length;
+    uint8_t _slots;
+    uint8_t _tail;      // oldest record
+    uint8_t _count;
+    uint8_t _sequence;  // sequence of the next record
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "Arduino.h"
+#include <avr/eeprom.h>
+
+#include "FrameCounter.h"
+
+FrameCounter::FrameCounter(uint16_t address, uint8_t slots, uint8_t interval) {
+  _address = address;
+  _slots = slots;
+  _interval = interval;
+  _slot = slots - 1;
+  _counter = 0;
+}
+
+
+/*
+ * The last checkpoint is the highest value in the ring: the next one is
+ * written in the slot that follows it.
+ */
+uint32_t FrameCounter::begin() {
+  _counter = 0;
+  _slot = _slots - 1;
+
+  for (uint8_t i = 0; i < _slots; i++) {
+    uint32_t value = ~eeprom_read_dword(slotAddress(i));
+    if (value > _counter) {
+      _counter = value;
+      _slot = i;
+    }
+  }
+
+  return _counter;
+}
+
+
+uint32_t FrameCounter::next() {
+  // first frame of a block: save where the following block starts
+  // before sending any frame of this one
+  if (_counter % _interval == 0) {
+    _slot = (_slot + 1) % _slots;
+    eeprom_update_dword(slotAddress(_slot), ~(_counter + _interval));
+  }
+
+  return _counter++;
+}
+
+
+void FrameCounter::reset() {
+  for (uint8_t i = 0; i < _slots; i++) {
+    eeprom_update_dword(slotAddress(i), 0xFFFFFFFF);
+  }
+
+  _counter = 0;
+  _slot = _slots - 1;
+}
+
+
+/* ############### PRIVATE FUNCTIONS ################## */
+
+uint32_t *FrameCounter::slotAddress(uint8_t slot) {
+  return (uint32_t *)(uintptr_t)(_address + 4 * slot);
+}
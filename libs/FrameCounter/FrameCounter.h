@@ -0,0 +1,54 @@
+#ifndef FRAMECOUNTER_H
+#define FRAMECOUNTER_H
+
+#include <stdint.h>
+
+/*
+ * 32 bit LoRaWAN uplink frame counter that survives resets and brown-outs.
+ *
+ * The counter is checkpointed in a ring of 4-byte EEPROM slots, once every
+ * `interval` frames: each checkpoint goes to the next slot, so the writes
+ * (100k cycles per cell) are spread over the whole ring. A checkpoint holds
+ * the first counter value of the next block of frames, so after a reset the
+ * counter skips ahead to it and never reuses a value the network has seen.
+ *
+ * Slots store the inverted value: an erased EEPROM (0xFF) reads as 0.
+ */
+class FrameCounter {
+  public:
+    /*!
+    * @brief Constructor
+    * @param address first EEPROM byte of the ring
+    * @param slots number of 4-byte slots in the ring
+    * @param interval frames between two checkpoints
+    */
+    FrameCounter(uint16_t address, uint8_t slots, uint8_t interval);
+
+    /*!
+    * @brief Restore the counter from the last checkpoint (call once in setup)
+    * @return Returns the counter value to start from
+    */
+    uint32_t begin();
+
+    /*!
+    * @brief Counter value for the next uplink, checkpointed when a new block starts
+    * @return Returns the frame counter to send
+    */
+    uint32_t next();
+
+    /*!
+    * @brief Restart the counter from 0 and erase the ring (new session keys)
+    */
+    void reset();
+
+  private:
+    uint32_t *slotAddress(uint8_t slot);
+
+    uint16_t _address;
+    uint8_t _slots;
+    uint8_t _interval;
+    uint8_t _slot;      // last slot written
+    uint32_t _counter;  // next counter value
+};
+
+#endif
@@ -8,151 +8,1634 @@
 */
 
 #include "Arduino.h"
+#include <avr/eeprom.h>
 #include "LoRaWAN.h"
 
 // enable this define if you use this code for The Things Stack V3. Read documentation
 // before using this setting.
 #define TTNSTACKV3
 
+// RX2 window: 869.525 MHz / 61.035 Hz = 14246334 = 0xD961BE
+#define RX2_FRF 0xD961BE
+
+#ifdef TTNSTACKV3
+// TTN uses SF9 for RX2
+#define RX2_SF 9
+#else
+#define RX2_SF 12
+#endif
+
+// JoinAccept windows after the JoinRequest (us)
+#define JOIN_ACCEPT_DELAY1 5000000UL
+#define JOIN_ACCEPT_DELAY2 6000000UL
+
+// OTAA session cache in EEPROM
+#define SESSION_DEV_NONCE   (LORAWAN_SESSION_EEPROM)
+#define SESSION_DEV_ADDR    (LORAWAN_SESSION_EEPROM + 2)
+#define SESSION_NWK_SKEY    (LORAWAN_SESSION_EEPROM + 6)
+#define SESSION_APP_SKEY    (LORAWAN_SESSION_EEPROM + 22)
+#define SESSION_DL_SETTINGS (LORAWAN_SESSION_EEPROM + 38)
+#define SESSION_RX_DELAY    (LORAWAN_SESSION_EEPROM + 39)
+#define SESSION_CFLIST      (LORAWAN_SESSION_EEPROM + 40)
+#define SESSION_CHECKSUM    (LORAWAN_SESSION_EEPROM + 55)
+
+// EU863-870 specifications
+static const unsigned long PROGMEM Default_Channels[LORAWAN_MAX_CHANNELS] = {
+  0xD9068B, //Channel 0 868.100 MHz / 61.035 Hz = 14222987 = 0xD9068B
+  0xD91358, //Channel 1 868.300 MHz / 61.035 Hz = 14226264 = 0xD91358
+  0xD92024, //Channel 2 868.500 MHz / 61.035 Hz = 14229540 = 0xD92024
+  // added five more channels
+  0xD8C68B, //Channel 3 867.100 MHz / 61.035 Hz = 14206603 = 0xD8C68B
+  0xD8D358, //Channel 4 867.300 MHz / 61.035 Hz = 14209880 = 0xD8D358
+  0xD8E024, //Channel 5 867.500 MHz / 61.035 Hz = 14213156 = 0xD8E024
+  0xD8ECF1, //Channel 6 867.700 MHz / 61.035 Hz = 14216433 = 0xD8ECF1
+  0xD8F9BE  //Channel 7 867.900 MHz / 61.035 Hz = 14219710 = 0xD8F9BE
+  // FSK       868.800 Mhz => not used in this config
+};
+
+// minimum number of preamble symbols the radio needs to lock on a downlink
+#define MIN_RX_SYMBOLS 6
+// time from RFM_Receive_Package call to receiver on (us)
+#define RX_WAKEUP_TIME 1000
+
 // constructor
 LoRaWAN::LoRaWAN(RFM95 &rfm95)
 {
-   _rfm95 = &rfm95;
+   _rfm95 = &rfm95;
+   _AppEui = NULL;
+   _DevEui = NULL;
+   _AppKey = NULL;
+
+   _Rx1_Delay = 1;
+   _Rx_Error = 5;
+
+   _Rx1_DR_Offset = 0;
+   _Rx2_Frf = RX2_FRF;
+   _Rx2_SF = RX2_SF;
+
+   _Frame_Counter_Rx = 0;
+   _Ack_Pending = 0;
+   _Rx_Data = NULL;
+   _Rx_Max = 0;
+   _Rx_Port = 0;
+   _Tx_Port = 1;
+   _Battery = 255;
+
+   for (unsigned char i = 0; i < LORAWAN_MAX_CHANNELS; i++)
+   {
+     _Channel_Frf[i] = pgm_read_dword(&Default_Channels[i]);
+   }
+   _Channel_Mask = 0xFF;
+   // 0xFF: not set by the network, use SF and power of the sketch
+   _Data_Rate = 0xFF;
+   _Tx_Power = 0xFF;
+   _Nb_Trans = 1;
+   _Confirmed_Tx = 4;
+   _Lbt_Attempts = 0;
+   _Cad_Count = 0;
+   _Cad_Busy = 0;
+   _Dr_Fallback = 1;
+   _Downlink_Received = 0;
+   _Ack_Received = 0;
+
+   _ADR = 0;
+   _ADR_Ack_Cnt = 0;
+
+   _Pc_Margin = 0;
+   _Pc_Period = 0;
+   _Pc_Count = 0;
+   _Link_Check_Pending = 0;
+   _Device_Time = 0;
+   _Device_Time_Frac = 0;
+   _Link_Margin = 0;
+   _Gw_Cnt = 0;
+   _Rx_SF = 12;
+
+   _Max_Duty_Cycle = 0;
+   _Dc_Off_Time = 0;
+
+   _FOpts_Length = 0;
+}
+
+
+void LoRaWAN::setKeys(unsigned char NwkSkey[], unsigned char AppSkey[], unsigned char DevAddr[])
+{
+  _NwkSkey = NwkSkey;
+  _AppSkey = AppSkey;
+  _DevAddr = DevAddr;
+}
+
+
+void LoRaWAN::setJoinKeys(unsigned char AppEui[], unsigned char DevEui[], unsigned char AppKey[])
+{
+  _AppEui = AppEui;
+  _DevEui = DevEui;
+  _AppKey = AppKey;
+}
+
+
+void LoRaWAN::forgetSession()
+{
+  eeprom_update_byte((uint8_t *)SESSION_CHECKSUM, eeprom_read_byte((uint8_t *)SESSION_CHECKSUM) + 1);
+}
+
+
+void LoRaWAN::setRxDelay(unsigned char Rx1_Delay)
+{
+  // RxDelay 0 means 1 s
+  _Rx1_Delay = Rx1_Delay ? Rx1_Delay : 1;
+}
+
+
+void LoRaWAN::setRxError(unsigned char Rx_Error)
+{
+  _Rx_Error = Rx_Error;
+}
+
+
+void LoRaWAN::setRxBuffer(unsigned char *Rx_Data, unsigned char Rx_Max)
+{
+  _Rx_Data = Rx_Data;
+  _Rx_Max = Rx_Max;
+}
+
+
+unsigned char LoRaWAN::getRxPort()
+{
+  return _Rx_Port;
+}
+
+
+void LoRaWAN::setTxPort(unsigned char Port)
+{
+  // 0 is reserved for MAC commands, 224-255 for tests and future use
+  _Tx_Port = (Port >= 1 && Port <= 223) ? Port : 1;
+}
+
+
+void LoRaWAN::setBatteryLevel(unsigned char Battery)
+{
+  _Battery = Battery;
+}
+
+
+void LoRaWAN::Time_Elapsed(unsigned long Ms)
+{
+  _Dc_Off_Time = (_Dc_Off_Time > Ms) ? _Dc_Off_Time - Ms : 0;
+}
+
+
+void LoRaWAN::setADR(unsigned char ADR)
+{
+  _ADR = ADR;
+  _ADR_Ack_Cnt = 0;
+}
+
+
+void LoRaWAN::setConfirmed(unsigned char Transmissions, unsigned char Dr_Fallback)
+{
+  _Confirmed_Tx = Transmissions ? Transmissions : 1;
+  _Dr_Fallback = Dr_Fallback;
+}
+
+
+void LoRaWAN::setListenBeforeTalk(unsigned char Attempts)
+{
+  _Lbt_Attempts = Attempts;
+}
+
+
+unsigned int LoRaWAN::getCadCount()
+{
+  return _Cad_Count;
+}
+
+
+unsigned int LoRaWAN::getCadBusy()
+{
+  return _Cad_Busy;
+}
+
+
+void LoRaWAN::setPowerControl(unsigned char Margin, unsigned char Period)
+{
+  _Pc_Margin = Margin;
+  _Pc_Period = Period;
+  _Pc_Count = 0;
+}
+
+
+unsigned char LoRaWAN::getLinkMargin()
+{
+  return _Link_Margin;
+}
+
+
+unsigned char LoRaWAN::getGatewayCount()
+{
+  return _Gw_Cnt;
+}
+
+
+void LoRaWAN::requestLinkCheck()
+{
+  unsigned char Request[1] = { 0x02 };
+  Mac_Queue(Request, 1);
+}
+
+
+void LoRaWAN::requestDeviceTime()
+{
+  unsigned char Request[1] = { 0x0D };
+  Mac_Queue(Request, 1);
+}
+
+
+unsigned long LoRaWAN::getDeviceTime()
+{
+  return _Device_Time;
+}
+
+/*
+*****************************************************************************************
+* Description : Function contstructs a LoRaWAN package and sends it
+*
+* Arguments   : *Data pointer to the array of data that will be transmitted
+*               Data_Length nuber of bytes to be transmitted
+*               Frame_Counter_Tx  32 bit frame counter of upstream frames
+*
+*               Confirmed  1 = confirmed data up, retransmitted until the ACK
+*
+* Returns     : Length of the application payload received in RX1 or RX2
+*               (copied to the buffer set with setRxBuffer), 0 if none,
+*               LORAWAN_DUTY_CYCLE if the frame was held back,
+*               LORAWAN_NO_ACK if a confirmed frame was not acknowledged
+*****************************************************************************************
+*/
+// MODIFICA: variabile "uint8_t SF" dell func. Send_Data
+signed char LoRaWAN::Send_Data(unsigned char *Data, unsigned char Data_Length, uint32_t Frame_Counter_Tx, uint8_t SF, unsigned char Confirmed)
+{
+  //Define variables
+  unsigned char i;
+  unsigned char Channel = LORAWAN_MAX_CHANNELS;
+  unsigned char Header[24];
+  unsigned char Header_Length;
+  unsigned char Frame_Length;
+  unsigned char Transmissions;
+  unsigned char Tx;
+  unsigned int Backoff;
+  unsigned char FOpts_Length;
+
+  //Direction of frame is up
+  unsigned char Direction = 0x00;
+
+  unsigned char RFM_Data[64];
+  unsigned char RFM_Package_Length;
+
+  unsigned char MIC[4];
+
+  /*
+    @leo:
+    https://hackmd.io/s/S1kg6Ymo-
+
+    7…5 bits	4…2 bits	1…0 bits
+    MType	    RFU	      Major
+
+    MType	Description
+    000	(0x00) Join Request
+    001	(0x20) Join Accept
+    010	(0x40) Unconfirmed Data Up
+    011	(0x60) Unconfirmed Data Down
+    100	(0x80) Confirmed Data Up
+    101	(0xA0) Confirmed Data Down
+    110	(0xC0) RFU
+    111	(0xE0) Proprietary
+  */
+
+
+  // Unconfirmed (0x40) or confirmed (0x80) data up
+  unsigned char Mac_Header = Confirmed ? 0x80 : 0x40;
+  // default frame control
+  unsigned char Frame_Control = 0x00;
+  // Frame port set by the sketch (default 1)
+  unsigned char Frame_Port = _Tx_Port;
+
+  // respect the maximum duty cycle set by the network (DutyCycleReq)
+  if (_Dc_Off_Time > 0)
+  {
+    return LORAWAN_DUTY_CYCLE;
+  }
+
+  // TX power control: periodic LinkCheckReq
+  if (_Pc_Period > 0 && ++_Pc_Count >= _Pc_Period)
+  {
+    _Pc_Count = 0;
+    requestLinkCheck();
+  }
+
+  #ifdef TTNSTACKV3
+  // the network expects RXParamSetupAns in the first uplink
+  if (Frame_Counter_Tx == 1)
+  {
+    unsigned char Answer[2] = { 0x05, 0x07 };
+    Mac_Queue(Answer, 2);
+  }
+  #endif
+
+  // pending MAC commands, unless they do not fit in the frame with the data
+  // (MHDR, FHDR, FPort, MIC: 13 bytes): then they wait for the next uplink
+  FOpts_Length = _FOpts_Length;
+  if (13U + FOpts_Length + Data_Length > sizeof(RFM_Data))
+  {
+    FOpts_Length = 0;
+  }
+
+  // FOptsLen and acknowledge of a confirmed downlink
+  Frame_Control = FOpts_Length;
+  if (_Ack_Pending)
+  {
+    Frame_Control |= 0x20;
+  }
+
+  // ADR: data rate and TX power set by LinkADRReq, or by the backoff
+  // when the network stops answering. The SF of the sketch is the starting point.
+  if (_ADR)
+  {
+    ADR_Backoff();
+
+    Frame_Control |= 0x80;
+    if (_ADR_Ack_Cnt >= ADR_ACK_LIMIT)
+    {
+      // ADRACKReq
+      Frame_Control |= 0x40;
+    }
+
+    if (_Data_Rate <= 5)
+    {
+      SF = 12 - _Data_Rate;
+    }
+    else
+    {
+      _Data_Rate = 12 - SF;
+    }
+  }
+
+  // EU868: TXPower 0 = 16 dBm (max EIRP), 2 dB steps. Set by LinkADRReq or by
+  // the power control, which also lowers the OCP limit with the power level.
+  if (_Tx_Power <= 7)
+  {
+    _rfm95->RFM_Set_Tx_Power(16 - 2 * _Tx_Power);
+
+    if (_Pc_Period > 0)
+    {
+      _rfm95->RFM_Set_OCP(_Tx_Power >= 3 ? 60 : (_Tx_Power >= 1 ? 80 : 100));
+    }
+  }
+
+  //Encrypt the data
+  Encrypt_Payload(Data, Data_Length, Frame_Counter_Tx, Direction, _AppSkey);
+
+  //Build the Radio Package
+  RFM_Data[0] = Mac_Header;
+
+  // little endian device address
+  RFM_Data[1] = _DevAddr[3];
+  RFM_Data[2] = _DevAddr[2];
+  RFM_Data[3] = _DevAddr[1];
+  RFM_Data[4] = _DevAddr[0];
+
+  RFM_Data[5] = Frame_Control;
+
+  // 16 least significant bits of the frame counter
+  RFM_Data[6] = (Frame_Counter_Tx & 0x00FF);
+  RFM_Data[7] = ((Frame_Counter_Tx >> 8) & 0x00FF);
+
+  // MAC commands in FOpts (not encrypted in LoRaWAN 1.0.x)
+  for(i = 0; i < FOpts_Length; i++)
+  {
+    RFM_Data[8 + i] = _FOpts[i];
+  }
+  RFM_Package_Length = 8 + FOpts_Length;
+  if (FOpts_Length > 0)
+  {
+    Mac_Sent();
+  }
+  _Ack_Pending = 0;
+
+  RFM_Data[RFM_Package_Length] = Frame_Port;
+  //Set Current package length
+  RFM_Package_Length++;
+
+  //Load Data
+  for(i = 0; i < Data_Length; i++)
+  {
+    RFM_Data[RFM_Package_Length + i] = Data[i];
+  }
+
+  //Add data Lenth to package length
+  RFM_Package_Length = RFM_Package_Length + Data_Length;
+
+  //Calculate MIC
+  Calculate_MIC(RFM_Data, MIC, RFM_Package_Length, Frame_Counter_Tx, Direction);
+
+  //Load MIC in package
+  for(i = 0; i < 4; i++)
+  {
+    RFM_Data[i + RFM_Package_Length] = MIC[i];
+  }
+
+  //Add MIC length to RFM package length
+  Frame_Length = RFM_Package_Length + 4;
+
+  // the receive windows reuse RFM_Data: keep the header (MHDR, FHDR, FPort) to
+  // rebuild the frame for the retransmissions, the data is encrypted in place
+  Header_Length = Frame_Length - Data_Length - 4;
+  memcpy(Header, RFM_Data, Header_Length);
+
+  if (_ADR && _ADR_Ack_Cnt < ADR_ACK_LIMIT + ADR_ACK_DELAY)
+  {
+    _ADR_Ack_Cnt++;
+  }
+
+  // confirmed: until the ACK, unconfirmed: NbTrans unless a downlink is received
+  Transmissions = Confirmed ? _Confirmed_Tx : _Nb_Trans;
+  RFM_Package_Length = 0;
+
+  for(Tx = 0; Tx < Transmissions; Tx++)
+  {
+    if (Tx > 0)
+    {
+      // random backoff (1-3 s), give up if the duty cycle needs longer
+      Backoff = 1000 + 8 * TCNT0;
+      if (_Dc_Off_Time > Backoff)
+      {
+        break;
+      }
+      TinySleep::wait(Backoff);
+      Time_Elapsed(Backoff);
+
+      memcpy(RFM_Data, Header, Header_Length);
+      memcpy(&RFM_Data[Header_Length], Data, Data_Length);
+      memcpy(&RFM_Data[Header_Length + Data_Length], MIC, 4);
+
+      // confirmed: one SF step up every second retransmission
+      if (Confirmed && _Dr_Fallback && (Tx & 0x01) == 0 && SF < 12)
+      {
+        SF++;
+      }
+    }
+
+    Channel = Select_Channel(Channel);
+    _rfm95->RFM_Set_Frequency(_Channel_Frf[Channel]);
+
+    // listen before talk: while a preamble is detected hop to another channel
+    // after a short random backoff, transmit anyway after _Lbt_Attempts
+    for(i = 0; i < _Lbt_Attempts; i++)
+    {
+      _Cad_Count++;
+      if (!_rfm95->RFM_Channel_Busy(SF))
+      {
+        break;
+      }
+      _Cad_Busy++;
+
+      TinySleep::idle(16 + (TCNT0 & 0x3F));
+      Channel = Select_Channel(Channel);
+      _rfm95->RFM_Set_Frequency(_Channel_Frf[Channel]);
+    }
+
+    //Send Package     MODIFICA: variabile "SF" della func. Send_Package
+    _rfm95->RFM_Send_Package(RFM_Data, Frame_Length, SF);
+
+    //Receive windows are timed from TxDone
+    unsigned long Rx_Reference = micros();
+
+    //Off time imposed by the duty cycle
+    if (_Max_Duty_Cycle > 0)
+    {
+      _Dc_Off_Time = Time_On_Air(Frame_Length, SF) * ((1UL << _Max_Duty_Cycle) - 1);
+    }
+
+    _Downlink_Received = 0;
+    _Ack_Received = 0;
+
+    // LinkCheckReq sent in this uplink, answered if cleared by Receive()
+    unsigned char Link_Check = _Link_Check_Pending;
+
+    //RX1: same channel of the uplink, SF shifted by RX1DROffset
+    _Rx_SF = min(SF + _Rx1_DR_Offset, 12);
+    RFM_Package_Length = Receive_Window(RFM_Data, _Rx_SF, Rx_Reference, _Rx1_Delay * 1000000UL);
+    if (RFM_Package_Length > 0)
+    {
+      RFM_Package_Length = Receive(RFM_Data, RFM_Package_Length);
+    }
+
+    //RX2: one second later on the RX2 channel, unless RX1 got a valid
+    //downlink for this device (another node's frame does not count)
+    if (!_Downlink_Received)
+    {
+      _rfm95->RFM_Set_Frequency(_Rx2_Frf);
+      _Rx_SF = _Rx2_SF;
+      RFM_Package_Length = Receive_Window(RFM_Data, _Rx_SF, Rx_Reference, (_Rx1_Delay + 1) * 1000000UL);
+      if (RFM_Package_Length > 0)
+      {
+        RFM_Package_Length = Receive(RFM_Data, RFM_Package_Length);
+      }
+    }
+
+    // TX power control, once per downlink: the LinkCheckAns already applied
+    // it, otherwise the margin of the downlink itself (which can only raise
+    // the power). No downlink to a LinkCheckReq: the link is lost, step up.
+    if (_Pc_Period > 0)
+    {
+      if (_Downlink_Received)
+      {
+        int Margin = Local_Margin();
+
+        if (!(Link_Check && !_Link_Check_Pending) && Margin < _Pc_Margin)
+        {
+          Power_Control(Margin, 1);
+        }
+      }
+      else if (_Link_Check_Pending)
+      {
+        Power_Control(0, 0);
+      }
+    }
+    _Link_Check_Pending = 0;
+
+    if (Confirmed ? _Ack_Received : _Downlink_Received)
+    {
+      break;
+    }
+  }
+
+  if (Confirmed && !_Ack_Received)
+  {
+    return LORAWAN_NO_ACK;
+  }
+
+  return RFM_Package_Length;
+}
+
+
+/*
+*****************************************************************************************
+* Description : OTAA activation. A session cached in EEPROM by a previous join is
+*               restored without transmitting, otherwise a JoinRequest is sent and
+*               the JoinAccept is awaited in RX1 (5 s, same channel and SF) and RX2
+*               (6 s). The session keys and DevAddr are written in the arrays set
+*               with setKeys.
+*
+* Arguments   : SF spreading factor of the JoinRequest
+*
+* Returns     : LORAWAN_RESTORED, LORAWAN_JOINED (new session: restart the frame
+*               counter), 0 if no JoinAccept was received or the duty cycle is
+*               not respected yet
+*****************************************************************************************
+*/
+unsigned char LoRaWAN::Join(uint8_t SF)
+{
+  unsigned char i;
+  unsigned char RFM_Data[64];
+  unsigned char RFM_Package_Length;
+  unsigned int Dev_Nonce;
+  unsigned long Rx_Reference;
+
+  if (Session_Restore())
+  {
+    return LORAWAN_RESTORED;
+  }
+
+  if (_Dc_Off_Time > 0)
+  {
+    return 0;
+  }
+
+  // DevNonce is saved before the JoinRequest is sent, so it is never reused
+  Dev_Nonce = eeprom_read_word((uint16_t *)SESSION_DEV_NONCE) + 1;
+  eeprom_update_word((uint16_t *)SESSION_DEV_NONCE, Dev_Nonce);
+
+  // JoinRequest: MHDR | AppEUI | DevEUI | DevNonce (little endian) | MIC
+  RFM_Data[0] = 0x00;
+  for(i = 0; i < 8; i++)
+  {
+    RFM_Data[1 + i] = _AppEui[7 - i];
+    RFM_Data[9 + i] = _DevEui[7 - i];
+  }
+  RFM_Data[17] = (Dev_Nonce & 0x00FF);
+  RFM_Data[18] = ((Dev_Nonce >> 8) & 0x00FF);
+
+  AES_CMAC(NULL, RFM_Data, 19, _AppKey, &RFM_Data[19]);
+
+  // the JoinAccept uses the default RX settings
+  _Rx1_DR_Offset = 0;
+  _Rx2_SF = RX2_SF;
+  _Rx2_Frf = RX2_FRF;
+
+  // join channels: the three default ones
+  _rfm95->RFM_Set_Frequency(pgm_read_dword(&Default_Channels[TCNT0 % 3]));
+  _rfm95->RFM_Send_Package(RFM_Data, 23, SF);
+  Rx_Reference = micros();
+
+  // 1% duty cycle for join retries
+  _Dc_Off_Time = Time_On_Air(23, SF) * 99;
+
+  RFM_Package_Length = Receive_Window(RFM_Data, SF, Rx_Reference, JOIN_ACCEPT_DELAY1);
+
+  if (RFM_Package_Length == 0 || !Join_Accept(RFM_Data, RFM_Package_Length, Dev_Nonce))
+  {
+    _rfm95->RFM_Set_Frequency(_Rx2_Frf);
+    RFM_Package_Length = Receive_Window(RFM_Data, _Rx2_SF, Rx_Reference, JOIN_ACCEPT_DELAY2);
+
+    if (RFM_Package_Length == 0 || !Join_Accept(RFM_Data, RFM_Package_Length, Dev_Nonce))
+    {
+      return 0;
+    }
+  }
+
+  return LORAWAN_JOINED;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Decrypt and verify a JoinAccept, derive the session keys and cache
+*               the session in EEPROM. The network encrypts the JoinAccept with
+*               AES decrypt, so AES encrypt (the only one available) reverses it.
+*
+* Returns     : 1 if the JoinAccept is valid, 0 otherwise
+*****************************************************************************************
+*/
+unsigned char LoRaWAN::Join_Accept(unsigned char *RFM_Data, unsigned char Package_Length, unsigned int Dev_Nonce)
+{
+  unsigned char i;
+  unsigned char MIC[4];
+
+  // MHDR | AppNonce | NetID | DevAddr | DLSettings | RxDelay | [CFList] | MIC
+  if (RFM_Data[0] != 0x20 || (Package_Length != 17 && Package_Length != 33))
+  {
+    return 0;
+  }
+
+  for(i = 1; i < Package_Length; i += 16)
+  {
+    AES_Encrypt(&RFM_Data[i], _AppKey);
+  }
+
+  AES_CMAC(NULL, RFM_Data, Package_Length - 4, _AppKey, MIC);
+  if (memcmp(MIC, &RFM_Data[Package_Length - 4], 4) != 0)
+  {
+    return 0;
+  }
+
+  // NwkSKey = aes128_encrypt(AppKey, 0x01 | AppNonce | NetID | DevNonce | pad16)
+  // AppSKey = aes128_encrypt(AppKey, 0x02 | AppNonce | NetID | DevNonce | pad16)
+  memset(_NwkSkey, 0, 16);
+  _NwkSkey[0] = 0x01;
+  memcpy(&_NwkSkey[1], &RFM_Data[1], 6);
+  _NwkSkey[7] = (Dev_Nonce & 0x00FF);
+  _NwkSkey[8] = ((Dev_Nonce >> 8) & 0x00FF);
+  memcpy(_AppSkey, _NwkSkey, 16);
+  _AppSkey[0] = 0x02;
+
+  AES_Encrypt(_NwkSkey, _AppKey);
+  AES_Encrypt(_AppSkey, _AppKey);
+
+  // little endian device address
+  _DevAddr[0] = RFM_Data[10];
+  _DevAddr[1] = RFM_Data[9];
+  _DevAddr[2] = RFM_Data[8];
+  _DevAddr[3] = RFM_Data[7];
+
+  // no CFList: keep the default channels
+  if (Package_Length == 17)
+  {
+    memset(&RFM_Data[13], 0xFF, 15);
+  }
+
+  Session_Apply(RFM_Data[11], RFM_Data[12], &RFM_Data[13]);
+
+  // cache the session
+  eeprom_update_block(_DevAddr, (void *)SESSION_DEV_ADDR, 4);
+  eeprom_update_block(_NwkSkey, (void *)SESSION_NWK_SKEY, 16);
+  eeprom_update_block(_AppSkey, (void *)SESSION_APP_SKEY, 16);
+  eeprom_update_byte((uint8_t *)SESSION_DL_SETTINGS, RFM_Data[11]);
+  eeprom_update_byte((uint8_t *)SESSION_RX_DELAY, RFM_Data[12]);
+  eeprom_update_block(&RFM_Data[13], (void *)SESSION_CFLIST, 15);
+  eeprom_update_byte((uint8_t *)SESSION_CHECKSUM, Session_Checksum(RFM_Data[11], RFM_Data[12], &RFM_Data[13]));
+
+  return 1;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Load the session cached in EEPROM by the last join
+*
+* Returns     : 1 if a valid session was restored, 0 otherwise
+*****************************************************************************************
+*/
+unsigned char LoRaWAN::Session_Restore()
+{
+  unsigned char Dl_Settings;
+  unsigned char Rx_Delay;
+  unsigned char CFList[15];
+
+  eeprom_read_block(_DevAddr, (void *)SESSION_DEV_ADDR, 4);
+  eeprom_read_block(_NwkSkey, (void *)SESSION_NWK_SKEY, 16);
+  eeprom_read_block(_AppSkey, (void *)SESSION_APP_SKEY, 16);
+  Dl_Settings = eeprom_read_byte((uint8_t *)SESSION_DL_SETTINGS);
+  Rx_Delay = eeprom_read_byte((uint8_t *)SESSION_RX_DELAY);
+  eeprom_read_block(CFList, (void *)SESSION_CFLIST, 15);
+
+  // erased EEPROM or session of another device
+  if ((_DevAddr[0] & _DevAddr[1] & _DevAddr[2] & _DevAddr[3]) == 0xFF ||
+      eeprom_read_byte((uint8_t *)SESSION_CHECKSUM) != Session_Checksum(Dl_Settings, Rx_Delay, CFList))
+  {
+    return 0;
+  }
+
+  Session_Apply(Dl_Settings, Rx_Delay, CFList);
+
+  return 1;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Apply the JoinAccept settings and start a new session
+*
+* Arguments   : Dl_Settings RX1DROffset and RX2 data rate
+*               Rx_Delay    RX1 delay (s), 0 = 1 s
+*               *CFList     frequencies of channels 3-7, 0xFF filled if none
+*****************************************************************************************
+*/
+void LoRaWAN::Session_Apply(unsigned char Dl_Settings, unsigned char Rx_Delay, unsigned char *CFList)
+{
+  unsigned char i;
+  unsigned long Frf;
+
+  _Rx1_DR_Offset = (Dl_Settings >> 4) & 0x07;
+  if ((Dl_Settings & 0x0F) <= 5)
+  {
+    _Rx2_SF = 12 - (Dl_Settings & 0x0F);
+  }
+  _Rx2_Frf = RX2_FRF;
+
+  _Rx1_Delay = Rx_Delay & 0x0F;
+  if (_Rx1_Delay == 0)
+  {
+    _Rx1_Delay = 1;
+  }
+
+  for(i = 0; i < LORAWAN_MAX_CHANNELS; i++)
+  {
+    _Channel_Frf[i] = pgm_read_dword(&Default_Channels[i]);
+  }
+  _Channel_Mask = 0xFF;
+
+  // CFList: a zero (or invalid) frequency disables the channel
+  if (CFList[0] != 0xFF || CFList[1] != 0xFF || CFList[2] != 0xFF)
+  {
+    for(i = 0; i < 5; i++)
+    {
+      Frf = Mac_Frequency(&CFList[3 * i]);
+      _Channel_Frf[3 + i] = Frf;
+      if (Frf == 0)
+      {
+        _Channel_Mask &= ~(1 << (3 + i));
+      }
+    }
+  }
+
+  _Frame_Counter_Rx = 0;
+  _Ack_Pending = 0;
+  _ADR_Ack_Cnt = 0;
+  _FOpts_Length = 0;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Checksum of the cached session, DevEUI included
+*****************************************************************************************
+*/
+unsigned char LoRaWAN::Session_Checksum(unsigned char Dl_Settings, unsigned char Rx_Delay, unsigned char *CFList)
+{
+  unsigned char i;
+  unsigned char Sum = 0x5A + Dl_Settings + Rx_Delay;
+
+  for(i = 0; i < 16; i++)
+  {
+    Sum += _NwkSkey[i] + _AppSkey[i];
+  }
+  for(i = 0; i < 15; i++)
+  {
+    Sum += CFList[i];
+  }
+  for(i = 0; i < 8; i++)
+  {
+    Sum += _DevEui[i];
+  }
+  for(i = 0; i < 4; i++)
+  {
+    Sum += _DevAddr[i];
+  }
+
+  return Sum;
+}
+
+
+/*
+*****************************************************************************************
+* Description : TCNT0 is timer0 continous timer, kind of random selection of an
+*               enabled channel, other than the Last one if possible
+*****************************************************************************************
+*/
+unsigned char LoRaWAN::Select_Channel(unsigned char Last)
+{
+  unsigned char Channel = TCNT0 % LORAWAN_MAX_CHANNELS;
+
+  while (!(_Channel_Mask & (1 << Channel)) || (Channel == Last && _Channel_Mask != (1 << Last)))
+  {
+    Channel = (Channel + 1) % LORAWAN_MAX_CHANNELS;
+  }
+
+  return Channel;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Function that checks a downlink package (DevAddr, FCnt, MIC),
+*               processes its MAC commands (FOpts or FRMPayload on FPort 0) and
+*               decrypts the application payload into the Rx buffer
+*
+* Arguments   : *RFM_Data pointer to the received package (decrypted in place)
+*               Package_Length length of the package
+*
+* Returns     : Length of the application payload, 0 if none or invalid package
+*****************************************************************************************
+*/
+unsigned char LoRaWAN::Receive(unsigned char *RFM_Data, unsigned char Package_Length)
+{
+  unsigned char i;
+  unsigned char MIC[4];
+  unsigned char Frame_Options_Length;
+  unsigned char Data_Length;
+  uint32_t Frame_Counter_Rx;
+
+  //Direction of frame is down
+  unsigned char Direction = 0x01;
+
+  // MHDR + FHDR + MIC
+  if (Package_Length < 12)
+  {
+    return 0;
+  }
+
+  // Unconfirmed (0x60) or Confirmed (0xA0) data down
+  if ((RFM_Data[0] & 0xE0) != 0x60 && (RFM_Data[0] & 0xE0) != 0xA0)
+  {
+    return 0;
+  }
+
+  // little endian device address
+  if (RFM_Data[1] != _DevAddr[3] || RFM_Data[2] != _DevAddr[2] ||
+      RFM_Data[3] != _DevAddr[1] || RFM_Data[4] != _DevAddr[0])
+  {
+    return 0;
+  }
+
+  Frame_Options_Length = RFM_Data[5] & 0x0F;
+  // 32 bit frame counter: upper bits from the last downlink. A lower value is
+  // taken as a 16 bit rollover, so that a replayed or old frame fails the MIC.
+  Frame_Counter_Rx = (_Frame_Counter_Rx & 0xFFFF0000UL) | RFM_Data[6] | ((uint32_t)RFM_Data[7] << 8);
+  if (Frame_Counter_Rx < _Frame_Counter_Rx)
+  {
+    Frame_Counter_Rx += 0x10000UL;
+  }
+
+  Package_Length = Package_Length - 4;
+  if (8 + Frame_Options_Length > Package_Length)
+  {
+    return 0;
+  }
+
+  //Verify MIC
+  Calculate_MIC(RFM_Data, MIC, Package_Length, Frame_Counter_Rx, Direction);
+  for(i = 0; i < 4; i++)
+  {
+    if (MIC[i] != RFM_Data[Package_Length + i])
+    {
+      return 0;
+    }
+  }
+
+  _Frame_Counter_Rx = Frame_Counter_Rx + 1;
+
+  // any downlink confirms that the network still receives our uplinks
+  _ADR_Ack_Cnt = 0;
+  _Downlink_Received = 1;
+  _Ack_Received = (RFM_Data[5] & 0x20) ? 1 : 0;
+
+  // ... and the sticky MAC answers
+  Mac_Received();
+
+  // confirmed data down must be acknowledged in the next uplink
+  if ((RFM_Data[0] & 0xE0) == 0xA0)
+  {
+    _Ack_Pending = 1;
+  }
+
+  //MAC commands in FOpts
+  Mac_Process(&RFM_Data[8], Frame_Options_Length);
+
+  i = 8 + Frame_Options_Length;
+  if (i >= Package_Length)
+  {
+    return 0;
+  }
+
+  //FPort and FRMPayload
+  _Rx_Port = RFM_Data[i];
+  i++;
+  Data_Length = Package_Length - i;
+
+  if (_Rx_Port == 0)
+  {
+    //MAC commands only, encrypted with the NwkSkey
+    Encrypt_Payload(&RFM_Data[i], Data_Length, Frame_Counter_Rx, Direction, _NwkSkey);
+    Mac_Process(&RFM_Data[i], Data_Length);
+    return 0;
+  }
+
+  Encrypt_Payload(&RFM_Data[i], Data_Length, Frame_Counter_Rx, Direction, _AppSkey);
+
+  // no buffer set for application downlinks
+  if (_Rx_Data == NULL)
+  {
+    return 0;
+  }
+
+  if (Data_Length > _Rx_Max)
+  {
+    Data_Length = _Rx_Max;
+  }
+  memcpy(_Rx_Data, &RFM_Data[i], Data_Length);
+
+  return Data_Length;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Sleeps until the receive window opens, then listens for a package.
+*               The window length (symbol timeout) and its offset from the nominal
+*               opening time cover the wake-up error of the MCU (_Rx_Error) and
+*               the minimum number of preamble symbols needed by the radio.
+*
+* Arguments   : *RFM_Data  buffer for the received package (64 bytes)
+*               SF         spreading factor of the window
+*               Reference  micros() value at TxDone, updated after a sleep
+*                          (micros() does not advance in power-down)
+*               Delay      window opening time after TxDone (us)
+*
+* Returns     : Length of the received package, 0 if none
+*****************************************************************************************
+*/
+unsigned char LoRaWAN::Receive_Window(unsigned char *RFM_Data, uint8_t SF, unsigned long &Reference, unsigned long Delay)
+{
+  // symbol time with BW = 125 kHz: 2^SF / 125 kHz = 8 us << SF
+  unsigned long Symbol_Time = 8UL << SF;
+  unsigned int Symbols;
+  long Offset;
+  long Wait;
+
+  // listen for enough symbols to catch MIN_RX_SYMBOLS of the 8 preamble symbols
+  // with a timing error of +/- _Rx_Error
+  Symbols = ((2 * MIN_RX_SYMBOLS - 8) * Symbol_Time + 2000UL * _Rx_Error + Symbol_Time - 1) / Symbol_Time;
+  if (Symbols < MIN_RX_SYMBOLS)
+  {
+    Symbols = MIN_RX_SYMBOLS;
+  }
+  if (Symbols > 1023)
+  {
+    Symbols = 1023;
+  }
+
+  // centre the window on the preamble
+  Offset = (long)(4 * Symbol_Time) - (long)(Symbols * Symbol_Time / 2) - RX_WAKEUP_TIME;
+
+  Wait = (long)Delay + Offset - (long)(micros() - Reference);
+  if (Wait > 1000)
+  {
+    TinySleep::wait(Wait / 1000);
+    Reference = micros() - (Delay + Offset - (Wait % 1000));
+  }
+
+  // the sub-millisecond remainder is busy-waited: the window opens on time
+  Wait = (long)Delay + Offset - (long)(micros() - Reference);
+  if (Wait > 0)
+  {
+    delayMicroseconds(Wait);
+  }
+
+  return _rfm95->RFM_Receive_Package(RFM_Data, 64, SF, Symbols);
+}
+
+
+
+
+/*
+*****************************************************************************************
+* Description : Time on air of a package (BW 125 kHz, CR 4/5, explicit header,
+*               CRC on, 8 preamble symbols), SX1276 4.1.1.7
+*
+* Returns     : Time on air (ms)
+*****************************************************************************************
+*/
+unsigned long LoRaWAN::Time_On_Air(unsigned char Package_Length, uint8_t SF)
+{
+  // symbol time (us)
+  unsigned long Symbol_Time = 8UL << SF;
+  // low data rate optimization for SF11 and SF12
+  int Denominator = 4 * (SF - (SF >= 11 ? 2 : 0));
+  int Numerator = 8 * Package_Length - 4 * SF + 44;
+  unsigned int Payload_Symbols = 8;
+
+  if (Numerator > 0)
+  {
+    Payload_Symbols += ((Numerator + Denominator - 1) / Denominator) * 5;
+  }
+
+  // preamble: 8 + 4.25 symbols
+  return ((4UL * Payload_Symbols + 49) * Symbol_Time / 4 + 999) / 1000;
+}
+
+
+/*
+*****************************************************************************************
+* Description : ADR backoff: if no downlink has been received ADR_ACK_DELAY uplinks
+*               after the first ADRACKReq, first restore the default (max) TX power,
+*               then lower the data rate one step every ADR_ACK_DELAY uplinks.
+*               At DR0 all the defined channels are enabled again.
+*****************************************************************************************
+*/
+void LoRaWAN::ADR_Backoff()
+{
+  unsigned char i;
+
+  if (_ADR_Ack_Cnt < ADR_ACK_LIMIT + ADR_ACK_DELAY)
+  {
+    return;
+  }
+
+  _ADR_Ack_Cnt = ADR_ACK_LIMIT;
+
+  if (_Tx_Power != 0)
+  {
+    _Tx_Power = 0;
+  }
+  else if (_Data_Rate > 0 && _Data_Rate <= 5)
+  {
+    _Data_Rate--;
+  }
+  else
+  {
+    for (i = 0; i < LORAWAN_MAX_CHANNELS; i++)
+    {
+      if (_Channel_Frf[i] != 0)
+      {
+        _Channel_Mask |= (1 << i);
+      }
+    }
+  }
+}
+
+
+/*
+*****************************************************************************************
+* Description : TX power control: step the power down (one 2 dB step per link check)
+*               while the margin exceeds the target by at least one step, step it up
+*               at once by the missing margin otherwise.
+*
+* Arguments   : Margin link margin (dB), may be negative
+*               Answered 0 if the link check was not answered (Margin ignored)
+*****************************************************************************************
+*/
+void LoRaWAN::Power_Control(int Margin, unsigned char Answered)
+{
+  unsigned char Steps;
+
+  // not set by the network yet: start from the power set by the sketch
+  if (_Tx_Power > 7)
+  {
+    uint8_t Power = _rfm95->RFM_Get_Tx_Power();
+    _Tx_Power = Power >= 16 ? 0 : (Power <= 2 ? 7 : (16 - Power) / 2);
+  }
+
+  if (!Answered)
+  {
+    // no answer, one step up
+    Steps = 1;
+  }
+  else if (Margin < _Pc_Margin)
+  {
+    Steps = (_Pc_Margin - Margin + 1) / 2;
+  }
+  else
+  {
+    if (Margin >= _Pc_Margin + 2 && _Tx_Power < 7)
+    {
+      _Tx_Power++;
+    }
+    return;
+  }
+
+  _Tx_Power = (_Tx_Power > Steps) ? _Tx_Power - Steps : 0;
+}
+
+
+/*
+*****************************************************************************************
+* Description : LinkCheckAns: Margin (dB above the demodulation floor of the last
+*               uplink, as received by the gateways) and GwCnt. The power control
+*               uses the lowest between this and the local downlink margin.
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Link_Check_Ans(unsigned char *Payload)
+{
+  int Margin = Payload[0];
+  int Local = Local_Margin();
+
+  _Link_Margin = Payload[0];
+  _Gw_Cnt = Payload[1];
+
+  if (_Pc_Period > 0 && _Link_Check_Pending)
+  {
+    Power_Control(min(Margin, Local), 1);
+  }
+  _Link_Check_Pending = 0;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Link margin of the last received package (dB). Below the noise floor
+*               the SNR is measured against the demodulation floor (-7.5 dB at SF7
+*               ... -20 dB at SF12). Above it the SNR saturates, so RegPktRssiValue
+*               is compared with the sensitivity instead (-123 dBm at SF7, 2.5 dB
+*               lower per SF, 125 kHz).
+*****************************************************************************************
+*/
+int LoRaWAN::Local_Margin()
+{
+  int Snr = _rfm95->RFM_Get_Pkt_SNR();
+
+  if (Snr < 0)
+  {
+    return Snr + (5 * _Rx_SF - 20) / 2;
+  }
+
+  return _rfm95->RFM_Get_Pkt_RSSI() + 123 + (5 * (_Rx_SF - 7)) / 2;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Dispatch the MAC commands received in FOpts or FRMPayload (FPort 0)
+*               to their handlers. Processing stops at the first unknown command,
+*               since its length is unknown.
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Process(unsigned char *Mac, unsigned char Mac_Length)
+{
+  unsigned char i = 0;
+  unsigned char Command_Length;
+
+  while (i < Mac_Length)
+  {
+    // length of the command, CID included
+    switch (Mac[i])
+    {
+      case 0x02: Command_Length = 3; break; // LinkCheckAns
+      case 0x03: Command_Length = 5; break; // LinkADRReq
+      case 0x04: Command_Length = 2; break; // DutyCycleReq
+      case 0x05: Command_Length = 5; break; // RXParamSetupReq
+      case 0x06: Command_Length = 1; break; // DevStatusReq
+      case 0x07: Command_Length = 6; break; // NewChannelReq
+      case 0x08: Command_Length = 2; break; // RXTimingSetupReq
+      case 0x09: Command_Length = 2; break; // TxParamSetupReq (not used in EU868)
+      case 0x0A: Command_Length = 5; break; // DlChannelReq
+      case 0x0D: Command_Length = 6; break; // DeviceTimeAns
+      default: return;
+    }
+
+    if (i + Command_Length > Mac_Length)
+    {
+      return;
+    }
+
+    switch (Mac[i])
+    {
+      case 0x02:
+        Mac_Link_Check_Ans(&Mac[i + 1]);
+        break;
+
+      case 0x03:
+        Mac_Link_ADR_Req(&Mac[i + 1]);
+        break;
+
+      case 0x04:
+        Mac_Duty_Cycle_Req(&Mac[i + 1]);
+        break;
+
+      case 0x05:
+        Mac_Rx_Param_Setup_Req(&Mac[i + 1]);
+        break;
+
+      case 0x06:
+        Mac_Dev_Status_Req();
+        break;
+
+      case 0x07:
+        Mac_New_Channel_Req(&Mac[i + 1]);
+        break;
+
+      case 0x08:
+        Mac_Rx_Timing_Setup_Req(&Mac[i + 1]);
+        break;
+
+      case 0x0A:
+      {
+        // DlChannelAns: separate downlink frequencies not supported
+        unsigned char Answer[2] = { 0x0A, 0x00 };
+        Mac_Queue(Answer, 2);
+        break;
+      }
+
+      case 0x0D:
+        // DeviceTimeAns: GPS seconds and 1/256 s at the end of the uplink
+        _Device_Time = (unsigned long)Mac[i + 1] | ((unsigned long)Mac[i + 2] << 8) |
+                       ((unsigned long)Mac[i + 3] << 16) | ((unsigned long)Mac[i + 4] << 24);
+        _Device_Time_Frac = Mac[i + 5];
+        break;
+
+      default:
+        break;
+    }
+
+    i += Command_Length;
+  }
+}
+
+
+/*
+*****************************************************************************************
+* Description : Queue a MAC command (answer or request) for FOpts of the next uplink.
+*               The outbox holds at most 15 bytes: a command that does not fit is
+*               dropped, as a request (LinkCheckReq, DeviceTimeReq) already queued.
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Queue(unsigned char *Answer, unsigned char Answer_Length)
+{
+  unsigned char i = 0;
+
+  if (_FOpts_Length + Answer_Length > sizeof(_FOpts))
+  {
+    return;
+  }
+
+  while (i < _FOpts_Length && (Answer[0] == 0x02 || Answer[0] == 0x0D))
+  {
+    if (_FOpts[i] == Answer[0])
+    {
+      return;
+    }
+    i += Mac_Uplink_Length(_FOpts[i]);
+  }
+
+  memcpy(&_FOpts[_FOpts_Length], Answer, Answer_Length);
+  _FOpts_Length += Answer_Length;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Length (CID included) of the MAC commands sent by the node
+*****************************************************************************************
+*/
+unsigned char LoRaWAN::Mac_Uplink_Length(unsigned char Cid)
+{
+  switch (Cid)
+  {
+    case 0x03: return 2; // LinkADRAns
+    case 0x05: return 2; // RXParamSetupAns
+    case 0x06: return 3; // DevStatusAns
+    case 0x07: return 2; // NewChannelAns
+    case 0x0A: return 2; // DlChannelAns
+    default: return 1;   // LinkCheckReq, DutyCycleAns, RXTimingSetupAns, DeviceTimeReq
+  }
 }
 
 
-void LoRaWAN::setKeys(unsigned char NwkSkey[], unsigned char AppSkey[], unsigned char DevAddr[])
+/*
+*****************************************************************************************
+* Description : Remove the commands just sent from the outbox. RXParamSetupAns,
+*               RXTimingSetupAns and DlChannelAns stay queued (and are repeated in
+*               every uplink) until a downlink is received.
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Sent()
 {
-  _NwkSkey = NwkSkey;
-  _AppSkey = AppSkey;
-  _DevAddr = DevAddr;
+  unsigned char i = 0;
+  unsigned char Length = 0;
+  unsigned char Command_Length;
+
+  while (i < _FOpts_Length)
+  {
+    Command_Length = Mac_Uplink_Length(_FOpts[i]);
+
+    if (_FOpts[i] == 0x05 || _FOpts[i] == 0x08 || _FOpts[i] == 0x0A)
+    {
+      memmove(&_FOpts[Length], &_FOpts[i], Command_Length);
+      Length += Command_Length;
+    }
+    else if (_FOpts[i] == 0x02)
+    {
+      _Link_Check_Pending = 1;
+    }
+
+    i += Command_Length;
+  }
+
+  _FOpts_Length = Length;
 }
 
+
 /*
 *****************************************************************************************
-* Description : Function contstructs a LoRaWAN package and sends it
-*
-* Arguments   : *Data pointer to the array of data that will be transmitted
-*               Data_Length nuber of bytes to be transmitted
-*               Frame_Counter_Up  Frame counter of upstream frames
-*
+* Description : A downlink was received: release RXParamSetupAns, RXTimingSetupAns
+*               and DlChannelAns. The other commands stay queued until they are sent.
 *****************************************************************************************
 */
-// MODIFICA: variabile "uint8_t SF" dell func. Send_Data
-void LoRaWAN::Send_Data(unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter_Tx, uint8_t SF)
+void LoRaWAN::Mac_Received()
 {
-  //Define variables
-  unsigned char i;
+  unsigned char i = 0;
+  unsigned char Length = 0;
+  unsigned char Command_Length;
 
-  //Direction of frame is up
-  unsigned char Direction = 0x00;
+  while (i < _FOpts_Length)
+  {
+    Command_Length = Mac_Uplink_Length(_FOpts[i]);
 
-  unsigned char RFM_Data[64];
-  unsigned char RFM_Package_Length;
+    if (_FOpts[i] != 0x05 && _FOpts[i] != 0x08 && _FOpts[i] != 0x0A)
+    {
+      memmove(&_FOpts[Length], &_FOpts[i], Command_Length);
+      Length += Command_Length;
+    }
 
-  unsigned char MIC[4];
+    i += Command_Length;
+  }
 
-  /*
-    @leo:
-    https://hackmd.io/s/S1kg6Ymo-
+  _FOpts_Length = Length;
+}
 
-    7…5 bits	4…2 bits	1…0 bits
-    MType	    RFU	      Major
 
-    MType	Description
-    000	(0x00) Join Request
-    001	(0x20) Join Accept
-    010	(0x40) Unconfirmed Data Up
-    011	(0x60) Unconfirmed Data Down
-    100	(0x80) Confirmed Data Up
-    101	(0xA0) Confirmed Data Down
-    110	(0xC0) RFU
-    111	(0xE0) Proprietary
-  */
+/*
+*****************************************************************************************
+* Description : LinkADRReq: DataRate_TXPower, ChMask (2 bytes), Redundancy.
+*               The settings are applied only if all of them are valid
+*               (EU868: DR0-5, TXPower 0-7, 0xF = keep current value).
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Link_ADR_Req(unsigned char *Payload)
+{
+  unsigned char Answer[2] = { 0x03, 0x07 };
+  unsigned char Data_Rate = Payload[0] >> 4;
+  unsigned char Tx_Power = Payload[0] & 0x0F;
+  unsigned int Channel_Mask = Payload[1] | ((unsigned int)Payload[2] << 8);
+  unsigned char Channel_Mask_Control = (Payload[3] >> 4) & 0x07;
+  unsigned char i;
 
+  if (Channel_Mask_Control == 6)
+  {
+    // all defined channels on
+    Channel_Mask = 0;
+    for (i = 0; i < LORAWAN_MAX_CHANNELS; i++)
+    {
+      if (_Channel_Frf[i] != 0)
+      {
+        Channel_Mask |= (1 << i);
+      }
+    }
+  }
+  else if (Channel_Mask_Control != 0)
+  {
+    Answer[1] &= ~0x01;
+  }
 
-  // Unconfirmed data up
-  unsigned char Mac_Header = 0x40;
-  // default frame control
-  unsigned char Frame_Control = 0x00;
-  // default Frame port
-  unsigned char Frame_Port = 0x01;
+  // undefined channels or all channels disabled
+  for (i = 0; i < 16; i++)
+  {
+    if ((Channel_Mask & (1 << i)) && (i >= LORAWAN_MAX_CHANNELS || _Channel_Frf[i] == 0))
+    {
+      Answer[1] &= ~0x01;
+    }
+  }
+  if (Channel_Mask == 0)
+  {
+    Answer[1] &= ~0x01;
+  }
 
-  #ifdef TTNSTACKV3
-  // first message with Tx parameter must be answered
-  if (Frame_Counter_Tx == 1)
+  if (Data_Rate > 5 && Data_Rate != 0x0F)
   {
-    // number of MAC commands (max 15)
-    Frame_Control = 0x02;
-    // do not add data
-    Data_Length = 0;
+    Answer[1] &= ~0x02;
   }
-  #endif
 
-  //Encrypt the data
-  Encrypt_Payload(Data, Data_Length, Frame_Counter_Tx, Direction);
+  if (Tx_Power > 7 && Tx_Power != 0x0F)
+  {
+    Answer[1] &= ~0x04;
+  }
 
-  //Build the Radio Package
-  RFM_Data[0] = Mac_Header;
+  if (Answer[1] == 0x07)
+  {
+    _Channel_Mask = Channel_Mask;
 
-  // little endian device address
-  RFM_Data[1] = _DevAddr[3];
-  RFM_Data[2] = _DevAddr[2];
-  RFM_Data[3] = _DevAddr[1];
-  RFM_Data[4] = _DevAddr[0];
+    if (Data_Rate != 0x0F)
+    {
+      _Data_Rate = Data_Rate;
+    }
+    if (Tx_Power != 0x0F)
+    {
+      _Tx_Power = Tx_Power;
+    }
 
-  RFM_Data[5] = Frame_Control;
+    // NbTrans 0 means 1
+    _Nb_Trans = (Payload[3] & 0x0F) ? (Payload[3] & 0x0F) : 1;
+  }
 
-  // 16 bit frame counter
-  RFM_Data[6] = (Frame_Counter_Tx & 0x00FF);
-  RFM_Data[7] = ((Frame_Counter_Tx >> 8) & 0x00FF);
+  Mac_Queue(Answer, 2);
+}
+
+
+/*
+*****************************************************************************************
+* Description : DutyCycleReq: aggregated duty cycle limited to 1 / 2^MaxDCycle
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Duty_Cycle_Req(unsigned char *Payload)
+{
+  unsigned char Answer[1] = { 0x04 };
+
+  _Max_Duty_Cycle = Payload[0] & 0x0F;
+
+  Mac_Queue(Answer, 1);
+}
+
+
+/*
+*****************************************************************************************
+* Description : RXParamSetupReq: DLsettings (RX1DRoffset, RX2DataRate) and RX2 frequency
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Rx_Param_Setup_Req(unsigned char *Payload)
+{
+  unsigned char Answer[2] = { 0x05, 0x07 };
+  unsigned char Rx1_DR_Offset = (Payload[0] >> 4) & 0x07;
+  unsigned char Rx2_Data_Rate = Payload[0] & 0x0F;
+  unsigned long Frf = Mac_Frequency(&Payload[1]);
 
-  // add FOpts data for second package
-  if (Frame_Control == 0x02)
+  if (Frf == 0)
   {
-    RFM_Data[8] = 0x05; // FrameOptions MAC command  RXParamSetupAns
-    RFM_Data[9] = 0x07; // All Paramesetup are succesfull: b00000111
-    RFM_Package_Length = 10;
+    Answer[1] &= ~0x01;
   }
-  else
+  if (Rx2_Data_Rate > 5)
+  {
+    Answer[1] &= ~0x02;
+  }
+  if (Rx1_DR_Offset > 5)
   {
-    RFM_Data[8] = Frame_Port;
-    //Set Current package length
-    RFM_Package_Length = 9;
+    Answer[1] &= ~0x04;
   }
 
-  //Load Data
-  for(i = 0; i < Data_Length; i++)
+  if (Answer[1] == 0x07)
   {
-    RFM_Data[RFM_Package_Length + i] = Data[i];
+    _Rx1_DR_Offset = Rx1_DR_Offset;
+    _Rx2_SF = 12 - Rx2_Data_Rate;
+    _Rx2_Frf = Frf;
   }
 
-  //Add data Lenth to package length
-  RFM_Package_Length = RFM_Package_Length + Data_Length;
+  Mac_Queue(Answer, 2);
+}
 
-  //Calculate MIC
-  Calculate_MIC(RFM_Data, MIC, RFM_Package_Length, Frame_Counter_Tx, Direction);
 
-  //Load MIC in package
-  for(i = 0; i < 4; i++)
+/*
+*****************************************************************************************
+* Description : DevStatusReq: battery level and SNR margin of the last downlink
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Dev_Status_Req()
+{
+  signed char Snr = _rfm95->RFM_Get_Pkt_SNR();
+  unsigned char Answer[3] = { 0x06, _Battery, 0x00 };
+
+  // 6 bit signed margin [-32, 31] dB
+  Snr = Snr > 31 ? 31 : (Snr < -32 ? -32 : Snr);
+  Answer[2] = Snr & 0x3F;
+
+  Mac_Queue(Answer, 3);
+}
+
+
+/*
+*****************************************************************************************
+* Description : NewChannelReq: ChIndex, Freq, DrRange. The default channels 0-2
+*               cannot be modified, Freq = 0 disables the channel (rejected if
+*               it is the last enabled one: Select_Channel needs one).
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_New_Channel_Req(unsigned char *Payload)
+{
+  unsigned char Answer[2] = { 0x07, 0x03 };
+  unsigned char Channel = Payload[0];
+  unsigned long Frf = Mac_Frequency(&Payload[1]);
+  unsigned char Min_Data_Rate = Payload[4] & 0x0F;
+  unsigned char Max_Data_Rate = Payload[4] >> 4;
+  unsigned char Disable = !(Payload[1] | Payload[2] | Payload[3]);
+
+  if (Channel < 3 || Channel >= LORAWAN_MAX_CHANNELS || (Frf == 0 && !Disable))
   {
-    RFM_Data[i + RFM_Package_Length] = MIC[i];
+    Answer[1] &= ~0x01;
+  }
+  else if (Disable && (_Channel_Mask & ~(1 << Channel)) == 0)
+  {
+    Answer[1] &= ~0x01;
+  }
+  if (Min_Data_Rate > Max_Data_Rate || Min_Data_Rate > 5)
+  {
+    Answer[1] &= ~0x02;
   }
 
-  //Add MIC length to RFM package length
-  RFM_Package_Length = RFM_Package_Length + 4;
+  if (Answer[1] == 0x03)
+  {
+    _Channel_Frf[Channel] = Frf;
+    if (Disable)
+    {
+      _Channel_Mask &= ~(1 << Channel);
+    }
+    else
+    {
+      _Channel_Mask |= (1 << Channel);
+    }
+  }
+
+  Mac_Queue(Answer, 2);
+}
+
 
-  //Send Package     MODIFICA: variabile "SF" della func. Send_Package
-  _rfm95->RFM_Send_Package(RFM_Data, RFM_Package_Length, SF);
+/*
+*****************************************************************************************
+* Description : RXTimingSetupReq: RX1 delay (s)
+*****************************************************************************************
+*/
+void LoRaWAN::Mac_Rx_Timing_Setup_Req(unsigned char *Payload)
+{
+  unsigned char Answer[1] = { 0x08 };
+
+  setRxDelay(Payload[0] & 0x0F);
+
+  Mac_Queue(Answer, 1);
 }
 
 
+/*
+*****************************************************************************************
+* Description : Convert a MAC command frequency (24 bits, little endian, 100 Hz steps)
+*               to the Frf register value: Frf = Freq * 100 / 61.035 = Freq * 1024 / 625
+*
+* Returns     : Frf, 0 if the frequency is outside the 863-870 MHz band
+*****************************************************************************************
+*/
+unsigned long LoRaWAN::Mac_Frequency(unsigned char *Freq)
+{
+  unsigned long Frequency = Freq[0] | ((unsigned long)Freq[1] << 8) | ((unsigned long)Freq[2] << 16);
+
+  if (Frequency < 8630000UL || Frequency > 8700000UL)
+  {
+    return 0;
+  }
+
+  return (Frequency / 625) * 1024 + ((Frequency % 625) * 1024) / 625;
+}
 
 
 /*
    Encryption stuff after this line
 */
-void LoRaWAN::Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction)
+void LoRaWAN::Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, uint32_t Frame_Counter, unsigned char Direction, unsigned char *Key)
 {
   unsigned char i = 0x00;
   unsigned char j;
@@ -187,15 +1670,15 @@ void LoRaWAN::Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, un
     Block_A[10] = (Frame_Counter & 0x00FF);
     Block_A[11] = ((Frame_Counter >> 8) & 0x00FF);
 
-    Block_A[12] = 0x00; //Frame counter upper Bytes
-    Block_A[13] = 0x00;
+    Block_A[12] = ((Frame_Counter >> 16) & 0x00FF); //Frame counter upper Bytes
+    Block_A[13] = ((Frame_Counter >> 24) & 0x00FF);
 
     Block_A[14] = 0x00;
 
     Block_A[15] = i;
 
     //Calculate S
-    AES_Encrypt(Block_A, _AppSkey); //original
+    AES_Encrypt(Block_A, Key); //original
 
 
     //Check for last block
@@ -222,11 +1705,48 @@ void LoRaWAN::Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, un
   }
 }
 
-void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction)
+void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, uint32_t Frame_Counter, unsigned char Direction)
 {
-  unsigned char i;
   unsigned char Block_B[16];
 
+  //Create Block_B
+  Block_B[0] = 0x49;
+  Block_B[1] = 0x00;
+  Block_B[2] = 0x00;
+  Block_B[3] = 0x00;
+  Block_B[4] = 0x00;
+
+  Block_B[5] = Direction;
+
+  Block_B[6] = _DevAddr[3];
+  Block_B[7] = _DevAddr[2];
+  Block_B[8] = _DevAddr[1];
+  Block_B[9] = _DevAddr[0];
+
+  Block_B[10] = (Frame_Counter & 0x00FF);
+  Block_B[11] = ((Frame_Counter >> 8) & 0x00FF);
+
+  Block_B[12] = ((Frame_Counter >> 16) & 0x00FF); //Frame counter upper bytes
+  Block_B[13] = ((Frame_Counter >> 24) & 0x00FF);
+
+  Block_B[14] = 0x00;
+  Block_B[15] = Data_Length;
+
+  AES_CMAC(Block_B, Data, Data_Length, _NwkSkey, Final_MIC);
+}
+
+/*
+*****************************************************************************************
+* Description : AES-CMAC (RFC 4493) of [Block_B | Data], first 4 bytes
+*
+* Arguments   : *Block_B first block of the message (B0), NULL if none (join messages)
+*               *Key     NwkSkey for data frames, AppKey for join messages
+*****************************************************************************************
+*/
+void LoRaWAN::AES_CMAC(unsigned char *Block_B, unsigned char *Data, unsigned char Data_Length, unsigned char *Key, unsigned char *Final_MIC)
+{
+  unsigned char i;
+
   unsigned char Key_K1[16] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
@@ -236,8 +1756,6 @@ void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsig
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
   };
 
-  //unsigned char Data_Copy[16];
-
   unsigned char Old_Data[16] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
@@ -252,29 +1770,6 @@ void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsig
   unsigned char Incomplete_Block_Size = 0x00;
   unsigned char Block_Counter = 0x01;
 
-  //Create Block_B
-  Block_B[0] = 0x49;
-  Block_B[1] = 0x00;
-  Block_B[2] = 0x00;
-  Block_B[3] = 0x00;
-  Block_B[4] = 0x00;
-
-  Block_B[5] = Direction;
-
-  Block_B[6] = _DevAddr[3];
-  Block_B[7] = _DevAddr[2];
-  Block_B[8] = _DevAddr[1];
-  Block_B[9] = _DevAddr[0];
-
-  Block_B[10] = (Frame_Counter & 0x00FF);
-  Block_B[11] = ((Frame_Counter >> 8) & 0x00FF);
-
-  Block_B[12] = 0x00; //Frame counter upper bytes
-  Block_B[13] = 0x00;
-
-  Block_B[14] = 0x00;
-  Block_B[15] = Data_Length;
-
   //Calculate number of Blocks and blocksize of last block
   Number_of_Blocks = Data_Length / 16;
   Incomplete_Block_Size = Data_Length % 16;
@@ -284,17 +1779,19 @@ void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsig
     Number_of_Blocks++;
   }
 
-  Generate_Keys(Key_K1, Key_K2);
+  Generate_Keys(Key_K1, Key_K2, Key);
 
   //Preform Calculation on Block B0
-
-  //Preform AES encryption
-  AES_Encrypt(Block_B, _NwkSkey);
-
-  //Copy Block_B to Old_Data
-  for(i = 0; i < 16; i++)
+  if(Block_B != NULL)
   {
-    Old_Data[i] = Block_B[i];
+    //Copy Block_B to Old_Data
+    for(i = 0; i < 16; i++)
+    {
+      Old_Data[i] = Block_B[i];
+    }
+
+    //Preform AES encryption
+    AES_Encrypt(Old_Data, Key);
   }
 
   //Preform full calculating until n-1 messsage blocks
@@ -311,7 +1808,7 @@ void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsig
     XOR(New_Data,Old_Data);
 
     //Preform AES encryption
-    AES_Encrypt(New_Data, _NwkSkey);
+    AES_Encrypt(New_Data, Key);
 
     //Copy New_Data to Old_Data
     for(i = 0; i < 16; i++)
@@ -341,8 +1838,7 @@ void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsig
     XOR(New_Data,Old_Data);
 
     //Preform last AES routine
-    // read NwkSkey from PROGMEM
-    AES_Encrypt(New_Data, _NwkSkey);
+    AES_Encrypt(New_Data, Key);
   }
   else
   {
@@ -371,7 +1867,7 @@ void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsig
     XOR(New_Data,Old_Data);
 
     //Preform last AES routine
-    AES_Encrypt(New_Data, _NwkSkey);
+    AES_Encrypt(New_Data, Key);
   }
 
   Final_MIC[0] = New_Data[0];
@@ -380,13 +1876,13 @@ void LoRaWAN::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsig
   Final_MIC[3] = New_Data[3];
 }
 
-void LoRaWAN::Generate_Keys(unsigned char *K1, unsigned char *K2)
+void LoRaWAN::Generate_Keys(unsigned char *K1, unsigned char *K2, unsigned char *Key)
 {
   unsigned char i;
   unsigned char MSB_Key;
 
-  //Encrypt the zeros in K1 with the NwkSkey
-  AES_Encrypt(K1,_NwkSkey);
+  //Encrypt the zeros in K1 with the key
+  AES_Encrypt(K1,Key);
 
   //Create K1
   //Check if MSB is 1
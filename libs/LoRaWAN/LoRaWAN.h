@@ -8,6 +8,7 @@
 */
 
 #include "RFM95.h"
+#include "TinySleep.h"
 #include "Arduino.h"
 
 #ifndef LoRaWAN_h
@@ -35,14 +36,90 @@ static const unsigned char PROGMEM S_Table[16][16] = {
 };
 
 
+// EU863-870 default channels (Frf register values, Freq / 61.035 Hz)
+#define LORAWAN_MAX_CHANNELS 8
+
+// ADR backoff (LoRaWAN 1.0.x): request an answer after ADR_ACK_LIMIT uplinks
+// without downlink, then step up power / down data rate every ADR_ACK_DELAY uplinks
+#define ADR_ACK_LIMIT 64
+#define ADR_ACK_DELAY 32
+
+// Send_Data return values < 0: the frame was not transmitted
+#define LORAWAN_DUTY_CYCLE -1
+#define LORAWAN_NO_ACK -2
+
+// Join return values
+#define LORAWAN_JOINED 1
+#define LORAWAN_RESTORED 2
+
+// OTAA session cache: DevNonce and session (56 bytes) at the end of the 512 byte EEPROM
+#define LORAWAN_SESSION_EEPROM 456
+
+
 class LoRaWAN
 {
   public:
     LoRaWAN(RFM95 &rfm95);
     void setKeys(unsigned char NwkSkey[], unsigned char AppSkey[], unsigned char DevAddr[]);
 
+    // OTAA: AppEUI, DevEUI (msb first) and AppKey. Join writes the session keys
+    // and DevAddr in the arrays set with setKeys.
+    void setJoinKeys(unsigned char AppEui[], unsigned char DevEui[], unsigned char AppKey[]);
+    unsigned char Join(uint8_t SF);
+
+    // invalidate the session cached in EEPROM: the next Join sends a JoinRequest
+    void forgetSession();
+
     // MODIFICA: variabile "uint8_t SF" dell func. Send_Data
-    void Send_Data(unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter_Tx, uint8_t SF);
+    signed char Send_Data(unsigned char *Data, unsigned char Data_Length, uint32_t Frame_Counter_Tx, uint8_t SF, unsigned char Confirmed = 0);
+
+    // validate and decrypt a downlink package, dispatch its MAC commands
+    unsigned char Receive(unsigned char *RFM_Data, unsigned char Package_Length);
+
+    // receive windows: RX1 delay (s) and maximum wake-up error of the MCU (ms)
+    void setRxDelay(unsigned char Rx1_Delay);
+    void setRxError(unsigned char Rx_Error);
+
+    // buffer for the application payload of downlinks, and its FPort
+    void setRxBuffer(unsigned char *Rx_Data, unsigned char Rx_Max);
+    unsigned char getRxPort();
+
+    // FPort of the next uplinks (1-223, default 1)
+    void setTxPort(unsigned char Port);
+
+    // battery level reported in DevStatusAns (0 = external power, 1-254, 255 = unknown)
+    void setBatteryLevel(unsigned char Battery);
+
+    // time spent sleeping since the last call (ms), used for duty cycle enforcement
+    void Time_Elapsed(unsigned long Ms);
+
+    // adaptive data rate: SF and TX power of each frame are set by the network
+    void setADR(unsigned char ADR);
+
+    // confirmed uplinks: at most Transmissions frames until the ACK, one SF step up
+    // every second retransmission if Dr_Fallback
+    void setConfirmed(unsigned char Transmissions, unsigned char Dr_Fallback);
+
+    // listen before talk: channel activity detection (up to Attempts channels) before
+    // each transmission, 0 = off. Counters of the CAD runs and of the busy channels.
+    void setListenBeforeTalk(unsigned char Attempts);
+    unsigned int getCadCount();
+    unsigned int getCadBusy();
+
+    // TX power control: send LinkCheckReq every Period uplinks (0 = off) and keep
+    // the link margin (dB) just above Margin
+    void setPowerControl(unsigned char Margin, unsigned char Period);
+
+    // last LinkCheckAns: margin (dB) and number of gateways
+    unsigned char getLinkMargin();
+    unsigned char getGatewayCount();
+
+    // MAC requests, sent in FOpts of the next uplink
+    void requestLinkCheck();
+    void requestDeviceTime();
+
+    // GPS time (s) from the last DeviceTimeAns, 0 if none
+    unsigned long getDeviceTime();
 
   private:
     RFM95 *_rfm95;
@@ -50,13 +127,104 @@ class LoRaWAN
     unsigned char *_NwkSkey;
     unsigned char *_AppSkey;
     unsigned char *_DevAddr;
+    unsigned char *_AppEui;
+    unsigned char *_DevEui;
+    unsigned char *_AppKey;
+
+    // receive windows settings
+    unsigned char _Rx1_Delay;
+    unsigned char _Rx_Error;
+    unsigned char _Rx1_DR_Offset;
+    uint8_t _Rx2_SF;
+    unsigned long _Rx2_Frf;
+
+    // downlink state
+    uint32_t _Frame_Counter_Rx;
+    unsigned char _Ack_Pending;
+    unsigned char *_Rx_Data;
+    unsigned char _Rx_Max;
+    unsigned char _Rx_Port;
+    unsigned char _Tx_Port;
+    unsigned char _Battery;
+
+    // channel plan and settings requested by LinkADRReq
+    unsigned long _Channel_Frf[LORAWAN_MAX_CHANNELS];
+    unsigned char _Channel_Mask;
+    unsigned char _Data_Rate;
+    unsigned char _Tx_Power;
+    unsigned char _Nb_Trans;
+
+    // retransmissions of confirmed frames, downlink of the last transmission
+    unsigned char _Confirmed_Tx;
+    unsigned char _Dr_Fallback;
+    unsigned char _Downlink_Received;
+    unsigned char _Ack_Received;
+
+    // listen before talk
+    unsigned char _Lbt_Attempts;
+    unsigned int _Cad_Count;
+    unsigned int _Cad_Busy;
+
+    // ADR state: uplinks sent since the last downlink
+    unsigned char _ADR;
+    unsigned int _ADR_Ack_Cnt;
+
+    // TX power control state
+    unsigned char _Pc_Margin;
+    unsigned char _Pc_Period;
+    unsigned char _Pc_Count;
+    unsigned char _Link_Check_Pending;
+    unsigned char _Link_Margin;
+    unsigned char _Gw_Cnt;
+    uint8_t _Rx_SF;
+
+    // last DeviceTimeAns: GPS seconds and fractional part (1/256 s)
+    unsigned long _Device_Time;
+    unsigned char _Device_Time_Frac;
+
+    // duty cycle: 1 / 2^_Max_Duty_Cycle, remaining off time (ms)
+    unsigned char _Max_Duty_Cycle;
+    unsigned long _Dc_Off_Time;
+
+    // MAC command outbox (answers and requests), sent in FOpts of the next uplink
+    unsigned char _FOpts[15];
+    unsigned char _FOpts_Length;
+
+    // OTAA
+    unsigned char Join_Accept(unsigned char *RFM_Data, unsigned char Package_Length, unsigned int Dev_Nonce);
+    unsigned char Session_Restore();
+    void Session_Apply(unsigned char Dl_Settings, unsigned char Rx_Delay, unsigned char *CFList);
+    unsigned char Session_Checksum(unsigned char Dl_Settings, unsigned char Rx_Delay, unsigned char *CFList);
+
+    unsigned char Select_Channel(unsigned char Last);
+    unsigned char Receive_Window(unsigned char *RFM_Data, uint8_t SF, unsigned long &Reference, unsigned long Delay);
+    unsigned long Time_On_Air(unsigned char Package_Length, uint8_t SF);
+    void ADR_Backoff();
+    void Power_Control(int Margin, unsigned char Answered);
+    int Local_Margin();
+
+    // MAC commands
+    void Mac_Process(unsigned char *Mac, unsigned char Mac_Length);
+    void Mac_Link_Check_Ans(unsigned char *Payload);
+    void Mac_Queue(unsigned char *Answer, unsigned char Answer_Length);
+    unsigned char Mac_Uplink_Length(unsigned char Cid);
+    void Mac_Sent();
+    void Mac_Received();
+    void Mac_Link_ADR_Req(unsigned char *Payload);
+    void Mac_Duty_Cycle_Req(unsigned char *Payload);
+    void Mac_Rx_Param_Setup_Req(unsigned char *Payload);
+    void Mac_Dev_Status_Req();
+    void Mac_New_Channel_Req(unsigned char *Payload);
+    void Mac_Rx_Timing_Setup_Req(unsigned char *Payload);
+    unsigned long Mac_Frequency(unsigned char *Freq);
 
     // MODIFICA: variabile "uint8_t SF" dell func. Send_Package
     void RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length, uint8_t SF);
     // security stuff:
-    void Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction);
-    void Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction);
-    void Generate_Keys(unsigned char *K1, unsigned char *K2);
+    void Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, uint32_t Frame_Counter, unsigned char Direction, unsigned char *Key);
+    void Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, uint32_t Frame_Counter, unsigned char Direction);
+    void AES_CMAC(unsigned char *Block_B, unsigned char *Data, unsigned char Data_Length, unsigned char *Key, unsigned char *Final_MIC);
+    void Generate_Keys(unsigned char *K1, unsigned char *K2, unsigned char *Key);
     void Shift_Left(unsigned char *Data);
     void XOR(unsigned char *New_Data,unsigned char *Old_Data);
     void AES_Encrypt(unsigned char *Data, unsigned char *Key);
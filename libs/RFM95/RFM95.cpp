@@ -23,6 +23,7 @@
 #endif
 #if TINY 
   #include <tinySPI.h>    //  MODIFICA  
+  #include <UsiBus.h>     // USI shared with the I2C sensors
 #endif
 
 
@@ -31,9 +32,17 @@ RFM95::RFM95(int DIO0, int NSS)
 {
   _DIO0 = DIO0;
   _NSS = NSS;
+  _Pkt_Snr = 0;
+  _Pkt_Rssi = 0;
+  _PA_Select = 1;
+  _Tx_Power = 14;
   // init tinySPI
-  SPI.setDataMode(SPI_MODE0);
-  SPI.begin();
+  #if TINY
+    UsiBus::acquireSPI();
+  #else
+    SPI.setDataMode(SPI_MODE0);
+    SPI.begin();
+  #endif
 }
 
 
@@ -128,6 +137,9 @@ void RFM95::RFM_Write(unsigned char RFM_Address, unsigned char RFM_Data)
   #if MEGA
     SPI.beginTransaction(settings);  // MODIFICA
   #endif
+  #if TINY
+    UsiBus::acquireSPI();  // no-op unless a sensor had the bus
+  #endif
 
   //Set NSS pin Low to start communication
   digitalWrite(_NSS,LOW);
@@ -162,6 +174,9 @@ unsigned char RFM95::RFM_Read(unsigned char RFM_Address)
   #if MEGA
     SPI.beginTransaction(settings);  // MODIFICA
   #endif
+  #if TINY
+    UsiBus::acquireSPI();  // no-op unless a sensor had the bus
+  #endif
 
   //Set NSS pin low to start SPI communication
   digitalWrite(_NSS,LOW);
@@ -211,98 +226,11 @@ void RFM95::RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Packag
   //Set carrier frequency
   delay(10);
 
-  /*
-  fixed frequency
-  // 868.100 MHz / 61.035 Hz = 14222987 = 0xD9068B
-  _rfm95.RFM_Write(0x06,0xD9);
-  _rfm95.RFM_Write(0x07,0x06);
-  _rfm95.RFM_Write(0x08,0x8B);
-  */
-
-  // TCNT0 is timer0 continous timer, kind of random selection of frequency
-
-  // EU863-870 specifications
-  switch (TCNT0 % 8)
-  {
-      case 0x00: //Channel 0 868.100 MHz / 61.035 Hz = 14222987 = 0xD9068B
-          RFM_Write(0x06,0xD9);
-          RFM_Write(0x07,0x06);
-          RFM_Write(0x08,0x8B);
-          break;
-        case 0x01: //Channel 1 868.300 MHz / 61.035 Hz = 14226264 = 0xD91358
-          RFM_Write(0x06,0xD9);
-          RFM_Write(0x07,0x13);
-          RFM_Write(0x08,0x58);
-          break;
-        case 0x02: //Channel 2 868.500 MHz / 61.035 Hz = 14229540 = 0xD92024
-          RFM_Write(0x06,0xD9);
-          RFM_Write(0x07,0x20);
-          RFM_Write(0x08,0x24);
-          break;
-        // added five more channels
-        case 0x03: // Channel 3 867.100 MHz / 61.035 Hz = 14206603 = 0xD8C68B
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xC6);
-          RFM_Write(0x08,0x8B);
-          break;
-        case 0x04: // Channel 4 867.300 MHz / 61.035 Hz = 14209880 = 0xD8D358
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xD3);
-          RFM_Write(0x08,0x58);
-          break;
-        case 0x05: // Channel 5 867.500 MHz / 61.035 Hz = 14213156 = 0xD8E024
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xE0);
-          RFM_Write(0x08,0x24);
-          break;
-        case 0x06: // Channel 6 867.700 MHz / 61.035 Hz = 14216433 = 0xD8ECF1
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xEC);
-          RFM_Write(0x08,0xF1);
-          break;
-        case 0x07: // Channel 7 867.900 MHz / 61.035 Hz = 14219710 = 0xD8F9BE
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xF9);
-          RFM_Write(0x08,0xBE);
-          break;
-        // FSK       868.800 Mhz => not used in this config
-        // 869.525 - SF9BW125 (RX2 downlink only) for package received
-
-    }
+  // carrier frequency is set by the caller (see RFM_Set_Frequency)
  
   // SF, BW 125 kHz
   // MOD: Set different SF accoring to user requirement:
-  switch (SF){
-    case 7: 
-      RFM_Write(0x1E,0x74); //SF7 CRC On 
-      break;
-
-    case 8:
-      RFM_Write(0x1E,0x84); //SF8 CRC On 
-      break;
-
-    case 9: 
-      RFM_Write(0x1E,0x94); //SF9 CRC On 
-      break;
-
-    case 10:
-      RFM_Write(0x1E,0xA4); //SF10 CRC On 
-      break;
-
-    case 11: 
-      RFM_Write(0x1E,0xB4); //SF11 CRC On 
-      RFM_Write(0x26,0x0C); //Low datarate optimization on AGC auto on
-      break;
-
-    case 12:
-      RFM_Write(0x1E,0xC4); //SF12 CRC On 
-      RFM_Write(0x26,0x0C); //Low datarate optimization on AGC auto on
-      break;
-
-    default:
-      RFM_Write(0x1E,0x74); //SF7 CRC On 
-      break;
-  }
+  RFM_Set_SF(SF);
 
   //RFM_Write(0x1E,0xB4); //SF7 CRC On 
   RFM_Write(0x1D,0x72); //125 kHz 4/5 coding rate explicit header mode
@@ -345,6 +273,9 @@ void RFM95::RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Packag
 // MOD: function used to set the TxPower level
 void RFM95::RFM_Set_Tx_Power(uint8_t output_power, uint8_t PA_select)
 {
+  _PA_Select = PA_select;
+  _Tx_Power = output_power;
+
   // If power amplifier !selected -> power limited below 14 dBm
   if (PA_select == 0) {
     // check if output power in range 0-14 dBm
@@ -391,6 +322,19 @@ void RFM95::RFM_Set_Tx_Power(uint8_t output_power, uint8_t PA_select)
 }
 
 
+// MOD: set the TxPower level with the power amplifier selected at init
+void RFM95::RFM_Set_Tx_Power(uint8_t output_power)
+{
+  RFM_Set_Tx_Power(output_power, _PA_Select);
+}
+
+
+uint8_t RFM95::RFM_Get_Tx_Power()
+{
+  return _Tx_Power;
+}
+
+
 //MOD: Function used to adjust the overcurrent protection limit:
 void RFM95::RFM_Set_OCP(uint8_t mA)
 {
@@ -415,3 +359,227 @@ void RFM95::RFM_Set_OCP(uint8_t mA)
   */
   RFM_Write(0x0B, 0x20 | (0x1F & ocpTrim));
 }
+
+
+/*
+*****************************************************************************************
+* Description : Function for receiving a package with the RFM (RxSingle mode).
+*               The receiver stays open until a preamble is detected or
+*               Symb_Timeout symbols have elapsed, so the window should be
+*               opened just before the expected downlink.
+*
+* Arguments   : *RFM_Rx_Package Pointer to array where the package is stored
+*               Max_Length      Size of the array
+*               SF              Spreading factor of the receive window
+*               Symb_Timeout    Rx timeout in symbols (4 - 1023)
+*
+* Returns     : Length of the received package, 0 on timeout / CRC error
+*****************************************************************************************
+*/
+unsigned char RFM95::RFM_Receive_Package(unsigned char *RFM_Rx_Package, unsigned char Max_Length, uint8_t SF, unsigned int Symb_Timeout)
+{
+  unsigned char i;
+  unsigned char RFM_Irq_Flags;
+  unsigned char RFM_Package_Length = 0;
+
+  //Set RFM in Standby mode
+  RFM_Write(0x01,0x81);
+
+  //Switch DIO0 to RxDone
+  RFM_Write(0x40,0x00);
+
+  //Set SF, the two MSBs of the symbol timeout are in RegModemConfig2
+  RFM_Set_SF(SF);
+  RFM_Write(0x1E,RFM_Read(0x1E) | ((Symb_Timeout >> 8) & 0x03));
+  RFM_Write(0x1F,Symb_Timeout & 0xFF);
+
+  //125 kHz 4/5 coding rate explicit header mode
+  RFM_Write(0x1D,0x72);
+
+  //Invert IQ for downlink
+  RFM_Write(0x33,0x67);
+  RFM_Write(0x3B,0x19);
+
+  //Rx part of the FiFo starts at 0x00
+  RFM_Write(0x0D,0x00);
+
+  //Clear IRQ flags
+  RFM_Write(0x12,0xFF);
+
+  //Switch RFM to RxSingle
+  RFM_Write(0x01,0x86);
+
+  //Wait for RxDone on DIO0 or RxTimeout (DIO1 is not connected, poll RegIrqFlags)
+  //3 s guard: longest 64 bytes package at SF12 plus margin
+  unsigned long RFM_Rx_Start = millis();
+  while( digitalRead(_DIO0) == LOW )
+  {
+    if ((RFM_Read(0x12) & 0x80) || (millis() - RFM_Rx_Start > 3000))
+    {
+      break;
+    }
+  }
+
+  RFM_Irq_Flags = RFM_Read(0x12);
+
+  //RxDone without PayloadCrcError
+  if ((RFM_Irq_Flags & 0x40) && !(RFM_Irq_Flags & 0x20))
+  {
+    RFM_Package_Length = RFM_Read(0x13);
+
+    if (RFM_Package_Length > Max_Length)
+    {
+      RFM_Package_Length = 0;
+    }
+
+    //Save signal quality of the package
+    _Pkt_Snr = RFM_Read(0x19);
+    _Pkt_Rssi = RFM_Read(0x1A);
+
+    //Set SPI pointer to start of the received package
+    RFM_Write(0x0D,RFM_Read(0x10));
+
+    for (i = 0; i < RFM_Package_Length; i++)
+    {
+      *RFM_Rx_Package = RFM_Read(0x00);
+      RFM_Rx_Package++;
+    }
+  }
+
+  //Clear IRQ flags, restore IQ and symbol timeout
+  RFM_Write(0x12,0xFF);
+  RFM_Write(0x33,0x27);
+  RFM_Write(0x3B,0x1D);
+  RFM_Write(0x1F,0x25);
+
+  //Switch RFM to sleep
+  RFM_Write(0x01,0x00);
+
+  return RFM_Package_Length;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Channel activity detection on the current frequency (listen before
+*               talk): the radio looks for a LoRa preamble at SF for ~2 symbols
+*               (~2 ms at SF7, ~66 ms at SF12)
+*
+* Returns     : 1 if a preamble was detected (CadDetected), 0 if the channel is free
+*****************************************************************************************
+*/
+unsigned char RFM95::RFM_Channel_Busy(uint8_t SF)
+{
+  unsigned char RFM_Irq_Flags;
+
+  //Set RFM in Standby mode
+  RFM_Write(0x01,0x81);
+
+  //Switch DIO0 to CadDone
+  RFM_Write(0x40,0x80);
+
+  //SF, 125 kHz 4/5 coding rate explicit header mode, IQ of the uplinks
+  RFM_Set_SF(SF);
+  RFM_Write(0x1D,0x72);
+  RFM_Write(0x33,0x27);
+  RFM_Write(0x3B,0x1D);
+
+  //Clear IRQ flags
+  RFM_Write(0x12,0xFF);
+
+  //Switch RFM to CAD
+  RFM_Write(0x01,0x87);
+
+  //Wait for CadDone on DIO0, 200 ms guard
+  unsigned long RFM_Cad_Start = millis();
+  while( digitalRead(_DIO0) == LOW )
+  {
+    if ((RFM_Read(0x12) & 0x04) || (millis() - RFM_Cad_Start > 200))
+    {
+      break;
+    }
+  }
+
+  RFM_Irq_Flags = RFM_Read(0x12);
+
+  //Clear IRQ flags, back to Standby (the transmission follows)
+  RFM_Write(0x12,0xFF);
+  RFM_Write(0x01,0x81);
+
+  return (RFM_Irq_Flags & 0x01) ? 1 : 0;
+}
+
+
+void RFM95::RFM_Set_Frequency(unsigned long Frf)
+{
+  RFM_Write(0x06,(Frf >> 16) & 0xFF);
+  RFM_Write(0x07,(Frf >> 8) & 0xFF);
+  RFM_Write(0x08,Frf & 0xFF);
+}
+
+
+/*
+*****************************************************************************************
+* Description : SNR of the last received package (RegPktSnrValue / 4)
+*****************************************************************************************
+*/
+signed char RFM95::RFM_Get_Pkt_SNR()
+{
+  return ((signed char)_Pkt_Snr) / 4;
+}
+
+
+/*
+*****************************************************************************************
+* Description : RSSI of the last received package, HF port (SX1276 5.5.5)
+*****************************************************************************************
+*/
+int RFM95::RFM_Get_Pkt_RSSI()
+{
+  if ((signed char)_Pkt_Snr < 0)
+  {
+    return -157 + _Pkt_Rssi + ((signed char)_Pkt_Snr) / 4;
+  }
+  return -157 + (_Pkt_Rssi * 16) / 15;
+}
+
+
+// MOD: function used to set the SF (BW 125 kHz, CRC on) and the low datarate optimization
+void RFM95::RFM_Set_SF(uint8_t SF)
+{
+  switch (SF){
+    case 8:
+      RFM_Write(0x1E,0x84); //SF8 CRC On 
+      break;
+
+    case 9: 
+      RFM_Write(0x1E,0x94); //SF9 CRC On 
+      break;
+
+    case 10:
+      RFM_Write(0x1E,0xA4); //SF10 CRC On 
+      break;
+
+    case 11: 
+      RFM_Write(0x1E,0xB4); //SF11 CRC On 
+      break;
+
+    case 12:
+      RFM_Write(0x1E,0xC4); //SF12 CRC On 
+      break;
+
+    default:
+      SF = 7;
+      RFM_Write(0x1E,0x74); //SF7 CRC On 
+      break;
+  }
+
+  if (SF >= 11)
+  {
+    RFM_Write(0x26,0x0C); //Low datarate optimization on AGC auto on
+  }
+  else
+  {
+    RFM_Write(0x26,0x04); //Low datarate optimization off AGC auto on
+  }
+}
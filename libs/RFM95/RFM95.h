@@ -27,13 +27,40 @@ class RFM95
 
     // MODIFICA: aggiunta funzione per aggiustare potenza in trasmissione
     void RFM_Set_Tx_Power(uint8_t output_power, uint8_t PA_select);
+    // same, keeping the PA selected at init
+    void RFM_Set_Tx_Power(uint8_t output_power);
+    // last TxPower level requested (dBm)
+    uint8_t RFM_Get_Tx_Power();
 
     // MODIFICA: aggiunta funzione per aggiustare OCP
     void RFM_Set_OCP(uint8_t mA);
 
+    // Receive a single package (RxSingle) for the LoRaWAN receive windows
+    unsigned char RFM_Receive_Package(unsigned char *RFM_Rx_Package, unsigned char Max_Length, uint8_t SF, unsigned int Symb_Timeout);
+
+    // Channel activity detection before a transmission, 1 if the channel is busy
+    unsigned char RFM_Channel_Busy(uint8_t SF);
+
+    // Set carrier frequency (register value, Frf = Freq / 61.035 Hz)
+    void RFM_Set_Frequency(unsigned long Frf);
+
+    // SNR (dB) and RSSI (dBm) of the last received package
+    signed char RFM_Get_Pkt_SNR();
+    int RFM_Get_Pkt_RSSI();
+
   private:
     int _DIO0;
     int _NSS;
+
+    // power amplifier and level set with the last RFM_Set_Tx_Power
+    uint8_t _PA_Select;
+    uint8_t _Tx_Power;
+
+    // RegPktSnrValue and RegPktRssiValue of the last received package
+    unsigned char _Pkt_Snr;
+    unsigned char _Pkt_Rssi;
+
+    void RFM_Set_SF(uint8_t SF);
 };
 
 
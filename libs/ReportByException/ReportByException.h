@@ -0,0 +1,85 @@
+#ifndef REPORTBYEXCEPTION_H
+#define REPORTBYEXCEPTION_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Report-by-exception policy in front of Send_Data: a sample is sent only if
+ * one of its fields moved by at least its deadband since the last sample
+ * sent, or if the heartbeat interval elapsed (the network still needs to
+ * know that the node is alive).
+ *
+ * Deadbands are template arguments, one per field, in the units of the
+ * values passed to check() (no RAM used):
+ *
+ *   // 1 %RH, 0.2 °C (0.01 units), 10 Pa; heartbeat every 30 samples
+ *   ReportByException<100, 20, 10> report(30);
+ *
+ *   if (report.check(hum, temp, press)) {
+ *     ... Send_Data ...
+ *     report.sent();
+ *   }
+ */
+template <int32_t... Deadbands>
+class ReportByException {
+  public:
+    static constexpr uint8_t fields = sizeof...(Deadbands);
+
+    /*!
+    * @brief Constructor
+    * @param heartbeat maximum number of samples (check calls) between two uplinks
+    */
+    ReportByException(uint16_t heartbeat) {
+      _heartbeat = heartbeat;
+      _age = 0;
+      _valid = false;
+    }
+
+    /*!
+    * @brief Compare a sample with the last one sent
+    * @return Returns true if the sample must be sent
+    */
+    template <typename... Values>
+    bool check(Values... values) {
+      static_assert(sizeof...(Values) == fields, "ReportByException: one value per deadband");
+      const int32_t deadband[fields] = { Deadbands... };
+      const int32_t sample[fields] = { (int32_t)values... };
+
+      memcpy(_pending, sample, sizeof(_pending));
+
+      if (_age < 0xFFFF) {
+        _age++;
+      }
+      if (!_valid || _age >= _heartbeat) {
+        return true;
+      }
+
+      for (uint8_t i = 0; i < fields; i++) {
+        int32_t delta = sample[i] - _last[i];
+        if (delta >= deadband[i] || -delta >= deadband[i]) {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    /*!
+    * @brief The last checked sample was sent: it becomes the new reference
+    */
+    void sent() {
+      memcpy(_last, _pending, sizeof(_last));
+      _valid = true;
+      _age = 0;
+    }
+
+  private:
+    int32_t _last[fields];     // last sample sent
+    int32_t _pending[fields];  // last sample checked
+    uint16_t _heartbeat;
+    uint16_t _age;             // samples since the last uplink
+    bool _valid;
+};
+
+#endif
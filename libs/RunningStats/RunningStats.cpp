@@ -0,0 +1,104 @@
+#include "RunningStats.h"
+
+RunningStats::RunningStats() {
+  reset();
+}
+
+
+void RunningStats::reset() {
+  _n = 0;
+  _min = 0x7FFF;
+  _max = -0x8000;
+  _mean = 0;
+  _m2 = 0;
+}
+
+
+/*
+ * delta  = x - mean
+ * mean  += delta / n
+ * M2    += delta * (x - mean)
+ * The division is rounded to the nearest Q8 step.
+ */
+void RunningStats::add(int16_t x) {
+  int32_t x_q8 = (int32_t)x << 8;
+  int32_t delta;
+
+  if (_n == 0xFFFF) {
+    return;
+  }
+  _n++;
+
+  if (x < _min) _min = x;
+  if (x > _max) _max = x;
+
+  delta = x_q8 - _mean;
+  if (delta >= 0) {
+    _mean += (delta + _n / 2) / _n;
+  } else {
+    _mean -= (-delta + _n / 2) / _n;
+  }
+
+  // both factors have the same sign (or the second one is 0 after rounding)
+  int64_t m2 = (int64_t)delta * (x_q8 - _mean);
+  if (m2 > 0) {
+    _m2 += m2;
+  }
+}
+
+
+uint16_t RunningStats::getCount() {
+  return _n;
+}
+
+
+int16_t RunningStats::getMin() {
+  return _min;
+}
+
+
+int16_t RunningStats::getMax() {
+  return _max;
+}
+
+
+int16_t RunningStats::getMean() {
+  return (_mean + 128) >> 8;
+}
+
+
+uint32_t RunningStats::getStdDev(uint8_t q8) {
+  if (_n < 2) {
+    return 0;
+  }
+
+  // variance in Q16 -> standard deviation in Q8
+  uint32_t sd = isqrt(_m2 / (_n - 1));
+
+  return q8 ? sd : (sd + 128) >> 8;
+}
+
+
+/* ############### PRIVATE FUNCTIONS ################## */
+
+// integer square root (bit by bit), floor(sqrt(x))
+uint32_t RunningStats::isqrt(uint64_t x) {
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+
+  while (bit > x) {
+    bit >>= 2;
+  }
+
+  while (bit) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return root;
+}
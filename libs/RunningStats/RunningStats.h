@@ -0,0 +1,57 @@
+#ifndef RUNNINGSTATS_H
+#define RUNNINGSTATS_H
+
+#include <stdint.h>
+
+/*
+ * Streaming min / max / mean / standard deviation of integer samples (e.g.
+ * 0.01 °C), to sample at every wake-up and send only the aggregate.
+ *
+ * Welford's algorithm in fixed point, no float: the mean is kept in Q8
+ * (1/256 of the sample unit) and the sum of squared deviations (M2) in Q16
+ * on 64 bits, so that rounding does not accumulate over long windows.
+ */
+class RunningStats {
+  public:
+    RunningStats();
+
+    /*!
+    * @brief Start a new window
+    */
+    void reset();
+
+    /*!
+    * @brief Add a sample to the window
+    */
+    void add(int16_t x);
+
+    /*!
+    * @brief Number of samples in the window
+    */
+    uint16_t getCount();
+
+    int16_t getMin();
+    int16_t getMax();
+
+    /*!
+    * @brief Mean of the window, rounded to the sample unit
+    */
+    int16_t getMean();
+
+    /*!
+    * @brief Sample standard deviation (n - 1) of the window
+    * @param q8 1: result in 1/256 of the sample unit, 0: rounded to the sample unit
+    */
+    uint32_t getStdDev(uint8_t q8 = 0);
+
+  private:
+    static uint32_t isqrt(uint64_t x);
+
+    uint16_t _n;
+    int16_t _min;
+    int16_t _max;
+    int32_t _mean;  // Q8
+    uint64_t _m2;   // Q16
+};
+
+#endif
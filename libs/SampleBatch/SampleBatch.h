@@ -0,0 +1,138 @@
+#ifndef SAMPLEBATCH_H
+#define SAMPLEBATCH_H
+
+#include <stdint.h>
+#include "BitPack.h"
+#include "DeltaCodec.h"
+
+/*
+ * Batch of K samples sent in a single uplink: one LoRaWAN overhead (13 bytes,
+ * preamble, radio start-up) for K samples instead of one per sample.
+ *
+ * The samples are kept bit-packed (Schema, see BitPack.h) in a RAM ring of
+ * K records: when the batch cannot be sent (e.g. duty cycle) the newest
+ * samples overwrite the oldest ones. read() copies the records oldest first,
+ * back to back, so the host decoder of the schema splits the payload into
+ * records; the last record was sampled at the uplink time, the others one
+ * sampling period apart.
+ *
+ *   SampleBatch<Payload, 8> batch;
+ *   batch.add(hum, temp);                  // every wake-up
+ *   if (batch.ready(15)) { ... batch.read(Data) ... batch.clear(); }
+ */
+template <typename Schema, uint8_t K>
+class SampleBatch {
+  public:
+    // payload size of a full batch
+    static constexpr uint8_t bytes = ((uint16_t)Schema::bits * K + 7) / 8;
+
+    // payload size of a full batch, delta coded (worst case)
+    static constexpr uint8_t deltaBytes = DeltaCodec<Schema>::maxBytes(K);
+
+    static_assert(K > 0, "SampleBatch: empty batch");
+    // 51 bytes: maximum application payload at SF12 (EU868)
+    static_assert(bytes <= 51, "SampleBatch: batch does not fit in an uplink");
+
+    SampleBatch() {
+      clear();
+    }
+
+    /*!
+    * @brief Add a sample (one value per field of the schema)
+    */
+    template <typename... Values>
+    void add(Values... values) {
+      if (_count == K) {
+        // full: drop the oldest sample, the age now counts from the next one
+        _first = (_first + 1) % K;
+        _count--;
+        _age = _age > _gap[_first] ? _age - _gap[_first] : 0;
+      }
+
+      uint8_t slot = (_first + _count) % K;
+      _gap[slot] = _since;
+      _since = 0;
+      Schema::pack(_ring, (uint16_t)slot * Schema::bits, values...);
+      _count++;
+    }
+
+    /*!
+    * @brief Count the wake-ups (call once per wake-up) for the latency deadline
+    */
+    void tick() {
+      if (_count > 0) {
+        if (_age < 0xFFFF) _age++;
+        if (_since < 0xFF) _since++;
+      }
+    }
+
+    /*!
+    * @brief Check if the batch must be sent
+    * @param deadline maximum number of wake-ups (tick) since the oldest sample
+    * @return Returns true if the batch is full or the oldest sample is too old
+    */
+    bool ready(uint16_t deadline) const {
+      return _count == K || (_count > 0 && _age >= deadline);
+    }
+
+    // number of samples in the batch
+    uint8_t count() const {
+      return _count;
+    }
+
+    /*!
+    * @brief Copy the samples, oldest first, to the uplink payload
+    * @param buf payload buffer (at least bytes long)
+    * @return Returns the payload length (bytes)
+    */
+    uint8_t read(uint8_t *buf) const {
+      uint16_t out = 0;
+
+      for (uint8_t i = 0; i < _count; i++) {
+        uint16_t in = (uint16_t)((_first + i) % K) * Schema::bits;
+
+        // copy the record 16 bits at a time
+        for (uint16_t n = 0; n < Schema::bits; n += 16) {
+          uint8_t width = Schema::bits - n < 16 ? Schema::bits - n : 16;
+          BitStream::write(buf, out + n, width, BitStream::read(_ring, in + n, width));
+        }
+        out += Schema::bits;
+      }
+
+      // clear the padding bits
+      if (out & 0x07) {
+        BitStream::write(buf, out, 8 - (out & 0x07), 0);
+      }
+
+      return (out + 7) / 8;
+    }
+
+    /*!
+    * @brief Copy the samples delta coded (see DeltaCodec.h) to the uplink payload
+    * @param buf payload buffer (at least deltaBytes long)
+    * @return Returns the payload length (bytes)
+    */
+    uint8_t readDelta(uint8_t *buf) const {
+      return DeltaCodec<Schema>::encode(buf, _ring, _first, _count, K);
+    }
+
+    /*!
+    * @brief Empty the batch (after the uplink)
+    */
+    void clear() {
+      _first = 0;
+      _count = 0;
+      _age = 0;
+      _since = 0;
+    }
+
+  private:
+    uint8_t _ring[bytes];
+    uint8_t _first;   // oldest record
+    uint8_t _count;
+    uint16_t _age;    // wake-ups since the oldest sample
+    uint8_t _gap[K];  // wake-ups between each record and the previous one
+    uint8_t _since;   // wake-ups since the newest sample
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SENSORGROUP_H
+#define SENSORGROUP_H
+
+#include <stdint.h>
+#include "TinySleep.h"
+
+/*
+ * Sample several sensors in parallel: each conversion is started back to
+ * back, the MCU sleeps once until the slowest one is due, then all the
+ * results are collected. The sensing time is the longest conversion instead
+ * of the sum of all of them.
+ *
+ * Any driver with the split phase methods can be grouped (no virtual calls,
+ * the group is resolved at compile time):
+ *
+ *   bool start();              // trigger a conversion, return immediately
+ *   uint8_t conversionTime();  // ms until the result is expected
+ *   bool collect();            // wait for the end (bounded) and read it
+ *
+ *   SensorGroup<AHT20, BMP280> sensors(aht20, bmp280);
+ *   if (sensors.sample()) { ... aht20.getHumidityCenti(), bmp280.getPressure() ... }
+ */
+template <typename... Sensors>
+class SensorGroup;
+
+template <>
+class SensorGroup<> {
+  public:
+    bool start() {
+      return true;
+    }
+
+    uint8_t conversionTime() {
+      return 0;
+    }
+
+    bool collect() {
+      return true;
+    }
+};
+
+template <typename S, typename... Rest>
+class SensorGroup<S, Rest...> {
+  public:
+    SensorGroup(S& sensor, Rest&... rest) : _sensor(sensor), _rest(rest...) {}
+
+    /*!
+    * @brief Start, sleep (TinySleep) and collect all the sensors
+    * @return Returns true if all the sensors were read
+    */
+    bool sample() {
+      bool ok = start();
+      TinySleep::wait(conversionTime());
+      return collect() && ok;
+    }
+
+    // start all the conversions (even if one fails)
+    bool start() {
+      bool ok = _sensor.start();
+      return _rest.start() && ok;
+    }
+
+    // longest conversion time (ms)
+    uint8_t conversionTime() {
+      uint8_t time = _sensor.conversionTime();
+      uint8_t rest = _rest.conversionTime();
+      return time > rest ? time : rest;
+    }
+
+    // collect all the results (even if one fails)
+    bool collect() {
+      bool ok = _sensor.collect();
+      return _rest.collect() && ok;
+    }
+
+  private:
+    S& _sensor;
+    SensorGroup<Rest...> _rest;
+};
+
+#endif
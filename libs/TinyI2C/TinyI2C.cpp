@@ -0,0 +1,177 @@
+#include "Arduino.h"
+#include <util/delay.h>
+
+#include "TinyI2C.h"
+#include <UsiBus.h>
+
+bool TinyI2C::_timeout = false;
+
+// USI pins of the ATtiny84
+#define I2C_DDR   DDRA
+#define I2C_PORT  PORTA
+#define I2C_PIN   PINA
+#define I2C_SDA   PORTA6
+#define I2C_SCL   PORTA4
+
+// fast mode: SCL low >= 1.3 us, high >= 0.6 us
+#define I2C_T_LOW   1.3
+#define I2C_T_HIGH  0.6
+
+// clock stretching: give up after ~10 ms (SCL held low, missing pull-up)
+#define I2C_STRETCH_US 10000
+
+// two-wire mode, software clock strobe
+#define I2C_USICR ((1 << USIWM1) | (1 << USICS1) | (1 << USICLK))
+
+// clear the flags, count 16 edges (8 bits) or 2 edges (1 bit: ACK)
+#define I2C_USISR_8BIT ((1 << USISIF) | (1 << USIOIF) | (1 << USIPF) | (1 << USIDC) | (0x0 << USICNT0))
+#define I2C_USISR_1BIT ((1 << USISIF) | (1 << USIOIF) | (1 << USIPF) | (1 << USIDC) | (0xE << USICNT0))
+
+
+void TinyI2C::begin() {
+  // pull-ups enabled, SCL and SDA released
+  I2C_PORT |= (1 << I2C_SDA) | (1 << I2C_SCL);
+  I2C_DDR |= (1 << I2C_SCL) | (1 << I2C_SDA);
+
+  USIDR = 0xFF;
+  USICR = I2C_USICR;
+  USISR = I2C_USISR_8BIT;
+}
+
+
+void TinyI2C::acquire() {
+  if (UsiBus::claim(UsiBus::BUS_I2C)) {
+    begin();
+  }
+}
+
+
+bool TinyI2C::write(uint8_t address, const uint8_t *data, uint8_t length) {
+  bool ack = start(address, false);
+
+  for (uint8_t i = 0; i < length && ack; i++) {
+    ack = write(data[i]);
+  }
+  stop();
+
+  return ack && !_timeout;
+}
+
+
+bool TinyI2C::read(uint8_t address, uint8_t *buffer, uint8_t length) {
+  bool ack = start(address, true);
+
+  for (uint8_t i = 0; i < length && ack && !_timeout; i++) {
+    buffer[i] = read(i == length - 1);
+  }
+  stop();
+
+  return ack && !_timeout;
+}
+
+
+bool TinyI2C::readRegister(uint8_t address, uint8_t reg, uint8_t *buffer, uint8_t length) {
+  if (!start(address, false) || !write(reg)) {
+    stop();
+    return false;
+  }
+
+  return read(address, buffer, length);
+}
+
+
+bool TinyI2C::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+  uint8_t data[2] = { reg, value };
+
+  return write(address, data, 2);
+}
+
+
+bool TinyI2C::start(uint8_t address, bool read) {
+  // release SCL (wait for a stretching slave), then SDA low while SCL high
+  _timeout = false;
+  I2C_PORT |= (1 << I2C_SCL);
+  if (!waitScl()) return false;
+  _delay_us(I2C_T_HIGH);
+
+  I2C_PORT &= ~(1 << I2C_SDA);
+  _delay_us(I2C_T_HIGH);
+  I2C_PORT &= ~(1 << I2C_SCL);
+  I2C_PORT |= (1 << I2C_SDA);
+
+  return write((address << 1) | (read ? 0x01 : 0x00));
+}
+
+
+bool TinyI2C::write(uint8_t data) {
+  I2C_PORT &= ~(1 << I2C_SCL);
+  USIDR = data;
+  transfer(I2C_USISR_8BIT);
+
+  // ACK: SDA low driven by the slave
+  I2C_DDR &= ~(1 << I2C_SDA);
+  return (transfer(I2C_USISR_1BIT) & 0x01) == 0 && !_timeout;
+}
+
+
+uint8_t TinyI2C::read(bool last) {
+  I2C_DDR &= ~(1 << I2C_SDA);
+  uint8_t data = transfer(I2C_USISR_8BIT);
+
+  // ACK, or NACK after the last byte
+  USIDR = last ? 0xFF : 0x00;
+  transfer(I2C_USISR_1BIT);
+
+  return data;
+}
+
+
+void TinyI2C::stop() {
+  // SDA low, release SCL, then SDA high while SCL high
+  I2C_PORT &= ~(1 << I2C_SDA);
+  I2C_PORT |= (1 << I2C_SCL);
+  waitScl();
+  _delay_us(I2C_T_HIGH);
+  I2C_PORT |= (1 << I2C_SDA);
+  _delay_us(I2C_T_LOW);
+}
+
+
+/* ############### PRIVATE FUNCTIONS ################## */
+
+uint8_t TinyI2C::transfer(uint8_t status) {
+  USISR = status;
+
+  do {
+    _delay_us(I2C_T_LOW);
+    // rising SCL edge, wait for a stretching slave
+    USICR = I2C_USICR | (1 << USITC);
+    waitScl();
+    _delay_us(I2C_T_HIGH);
+    // falling SCL edge
+    USICR = I2C_USICR | (1 << USITC);
+  } while (!(USISR & (1 << USIOIF)));
+
+  _delay_us(I2C_T_LOW);
+  uint8_t data = USIDR;
+
+  // release SDA
+  USIDR = 0xFF;
+  I2C_DDR |= (1 << I2C_SDA);
+
+  return data;
+}
+
+
+bool TinyI2C::waitScl() {
+  // after a timeout the rest of the transaction is clocked out without waiting
+  for (uint16_t us = 0; !(I2C_PIN & (1 << I2C_SCL)); us++) {
+    if (_timeout || us >= I2C_STRETCH_US) {
+      _timeout = true;
+      return false;
+    }
+    _delay_us(1);
+  }
+
+  return true;
+}
@@ -0,0 +1,101 @@
+#ifndef TINYI2C_H
+#define TINYI2C_H
+
+#include <stdint.h>
+
+/*
+ * Lean I2C master on the ATtiny84 USI (SDA = PA6, SCL = PA4), fast mode
+ * (400 kHz at 8 MHz, slower at lower F_CPU: the bit timing is the I2C
+ * minimum plus the code overhead). Clock stretching is supported, up to
+ * ~10 ms: a slave holding SCL low (or a missing pull-up) fails the
+ * transaction instead of hanging the node.
+ *
+ * No internal buffer: reads go straight into the caller buffer and writes
+ * come from it (no requestFrom / available / read copy as in TinyWireM).
+ *
+ *   TinyI2C::begin();
+ *   TinyI2C::readRegister(0x77, 0xF7, buffer, 6);  // 6 bytes burst from 0xF7
+ *
+ * The USI is shared with the SPI of the RFM95: the sensor drivers take it
+ * with acquire() (see UsiBus.h), which calls begin() when needed.
+ */
+class TinyI2C {
+  public:
+    /*!
+    * @brief Configure the USI in two-wire mode and release the bus
+    */
+    static void begin();
+
+    /*!
+    * @brief Take the shared USI from the radio (UsiBus), begin() if needed
+    */
+    static void acquire();
+
+    /*!
+    * @brief Write a complete transaction (START, address, data, STOP)
+    * @return Returns true if every byte was acknowledged
+    */
+    static bool write(uint8_t address, const uint8_t *data, uint8_t length);
+
+    /*!
+    * @brief Read a complete transaction (START, address, data, STOP)
+    * @param buffer receives length bytes
+    * @return Returns true if the address was acknowledged
+    */
+    static bool read(uint8_t address, uint8_t *buffer, uint8_t length);
+
+    /*!
+    * @brief Write the register address, then read length bytes after a
+    *        repeated START (auto-incremented registers)
+    * @return Returns true if the device acknowledged
+    */
+    static bool readRegister(uint8_t address, uint8_t reg, uint8_t *buffer, uint8_t length);
+
+    /*!
+    * @brief Write one register
+    * @return Returns true if the device acknowledged
+    */
+    static bool writeRegister(uint8_t address, uint8_t reg, uint8_t value);
+
+    /*!
+    * @brief (Repeated) START and address byte
+    * @param read true for a read transfer
+    * @return Returns true if the address was acknowledged
+    */
+    static bool start(uint8_t address, bool read);
+
+    /*!
+    * @brief Send one byte
+    * @return Returns true if acknowledged
+    */
+    static bool write(uint8_t data);
+
+    /*!
+    * @brief Receive one byte
+    * @param last true for the last byte of the transfer (NACK)
+    */
+    static uint8_t read(bool last);
+
+    /*!
+    * @brief STOP condition, releases the bus
+    */
+    static void stop();
+
+  private:
+    /*!
+    * @brief Clock the USI shift register until the counter overflows
+    * @param status USISR value: counter preset (8 or 1 bit)
+    * @return Returns the shift register content
+    */
+    static uint8_t transfer(uint8_t status);
+
+    /*!
+    * @brief Wait for SCL high (clock stretching), at most ~10 ms
+    * @return Returns false on timeout (the current transaction fails)
+    */
+    static bool waitScl();
+
+    static bool _timeout;  // SCL stuck low during the current transaction
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "Arduino.h"
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <avr/interrupt.h>
+
+#include "TinySleep.h"
+
+// nominal watchdog period (prescaler 0) in us
+#define WDT_NOMINAL_PERIOD 16000
+
+// guard left to the idle phase of wait(): 2 ms + ~1.5 % of the power-down time
+#define WAIT_GUARD(us) (2000 + ((us) >> 6))
+
+uint16_t TinySleep::wdt_period = WDT_NOMINAL_PERIOD;
+volatile uint8_t TinySleep::_sleeping = 0;
+
+static volatile uint8_t timer1_match;
+
+ISR(TIM1_COMPA_vect) {
+  timer1_match = 1;
+}
+
+
+/*
+ * Idle sleep: Timer1 in CTC mode with clk/1024 prescaler
+ * (128 us resolution @ 8 MHz). Other interrupts (e.g. the Timer0 overflow
+ * used by millis()) may wake the MCU, so sleep again until the match.
+ */
+void TinySleep::idle(uint16_t ms) {
+  while (ms > 0) {
+    // limit each chunk so that OCR1A fits in 16 bits
+    uint16_t chunk = ms > 4000 ? 4000 : ms;
+    uint32_t ticks = ((uint32_t)chunk * (F_CPU / 1000)) >> 10;
+    ms -= chunk;
+
+    if (ticks == 0) continue;
+
+    TCCR1B = 0;
+    TCCR1A = 0;
+    TCNT1  = 0;
+    OCR1A  = ticks - 1;
+    timer1_match = 0;
+    TIFR1  = (1 << OCF1A);
+    TIMSK1 |= (1 << OCIE1A);
+    TCCR1B = (1 << WGM12) | (1 << CS12) | (1 << CS10); // CTC, clk/1024
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    while (!timer1_match) {
+      sleep_enable();
+      sei();        // the instruction after sei() is executed before any interrupt
+      sleep_cpu();
+      sleep_disable();
+      cli();
+    }
+    sei();
+
+    // stop Timer1
+    TCCR1B = 0;
+    TIMSK1 &= ~(1 << OCIE1A);
+  }
+}
+
+
+/*
+ * Power-down sleep: chain the longest watchdog timeouts that fit into the
+ * requested time (us), using the calibrated period. The watchdog runs in interrupt + reset mode:
+ * the hardware clears WDIE when the interrupt fires, which tells the
+ * watchdog wake-up apart from any other interrupt.
+ */
+uint16_t TinySleep::powerDown(uint16_t ms) {
+  return sleepWatchdog((uint32_t)ms * 1000) / 1000;
+}
+
+uint32_t TinySleep::sleepWatchdog(uint32_t remaining) {
+  uint32_t slept = 0;
+
+  //Disable ADC during sleep
+  uint8_t adcsra = ADCSRA;
+  ADCSRA &= ~(1 << ADEN);
+
+  while (remaining >= wdt_period) {
+    // longest timeout (16 ms << prescaler) not exceeding the remaining time
+    uint8_t prescaler = 0;
+    while (prescaler < 9 && ((uint32_t)wdt_period << (prescaler + 1)) <= remaining) {
+      prescaler++;
+    }
+
+    startWatchdog(prescaler);
+
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    cli();
+    while (WDTCSR & (1 << WDIE)) {
+      sleep_enable();
+      sleep_bod_disable();
+      sei();
+      sleep_cpu();
+      sleep_disable();
+      cli();
+    }
+    sei();
+    wdt_disable();
+    _sleeping = 0;
+
+    remaining -= (uint32_t)wdt_period << prescaler;
+    slept     += (uint32_t)wdt_period << prescaler;
+  }
+
+  ADCSRA = adcsra;
+
+  return slept;
+}
+
+
+/*
+ * Count Timer1 ticks (clk/64) over one 16 ms watchdog period. The CPU busy
+ * waits on WDIE so that the interrupt latency does not depend on other
+ * wake-up sources.
+ */
+void TinySleep::calibrate() {
+  TCCR1B = 0;
+  TCCR1A = 0;
+  TCNT1  = 0;
+
+  startWatchdog(0);
+  TCCR1B = (1 << CS11) | (1 << CS10); // normal mode, clk/64
+
+  while (WDTCSR & (1 << WDIE)) {
+  }
+
+  uint16_t ticks = TCNT1;
+  TCCR1B = 0;
+  wdt_disable();
+  _sleeping = 0;
+
+  // one clk/64 tick lasts 64e6 / F_CPU us
+  wdt_period = (uint32_t)ticks * (64000000UL / F_CPU);
+}
+
+
+/*
+ * Re-calibrate the watchdog (its period drifts with Vcc and temperature),
+ * power-down for the bulk of the interval minus a guard covering the
+ * residual error, then finish on Timer1.
+ */
+void TinySleep::wait(uint16_t ms) {
+  uint32_t remaining = (uint32_t)ms * 1000;
+
+  if (remaining > 4 * WDT_NOMINAL_PERIOD) {
+    calibrate();
+    remaining -= wdt_period;
+
+    uint32_t guard = WAIT_GUARD(remaining);
+    if (remaining > guard + wdt_period) {
+      remaining -= sleepWatchdog(remaining - guard);
+    }
+  }
+
+  idle(remaining / 1000);
+}
+
+
+/* ############### PRIVATE FUNCTIONS ################## */
+
+void TinySleep::startWatchdog(uint8_t prescaler) {
+  uint8_t wdtcsr = (1 << WDIE) | (1 << WDE) | (prescaler & 0x07);
+  if (prescaler & 0x08) {
+    wdtcsr |= (1 << WDP3);
+  }
+
+  // Prevent new interrupt generation
+  cli();
+  wdt_reset();
+  _sleeping = 1;
+
+  // Reset the watchdog reset flag
+  bitClear(MCUSR, WDRF);
+  // Start timed sequence
+  WDTCSR |= (1 << WDCE) | (1 << WDE);
+  WDTCSR = wdtcsr;
+
+  sei();
+}
@@ -0,0 +1,87 @@
+#ifndef TINYSLEEP_H
+#define TINYSLEEP_H
+
+#include <stdint.h>
+
+/*
+ * Short, timed MCU sleeps for the ATtiny84 (e.g. waiting for LoRaWAN
+ * receive windows or for a sensor conversion to complete).
+ *
+ * - idle():      Timer1 (CTC) wakes the MCU from idle mode. Accurate, but
+ *                the CPU clock keeps running.
+ * - powerDown(): the watchdog wakes the MCU from power-down. Lowest current,
+ *                but the WDT oscillator drifts with supply and temperature:
+ *                calibrate() measures its actual period against Timer1 so
+ *                that the requested sleep time is compensated.
+ * - wait():      combines both: power-down for the bulk of the interval,
+ *                then idle on Timer1 for the (short) remainder.
+ *
+ * NOTE: the watchdog interrupt handler is owned by the sketch
+ * (ISR(WDT_vect) must be defined, as in all the examples). The watchdog is
+ * run in interrupt + reset mode and disabled right after each timeout. The
+ * sketch handler is still called for these timeouts (e.g. while LoRaWAN
+ * waits for the receive windows): it should skip them when sleeping() is
+ * true, as the examples do:
+ *
+ *   ISR(WDT_vect) {
+ *     if (!TinySleep::sleeping()) sleep_count++;
+ *   }
+ *
+ * NOTE: Timer1 belongs to this library (ISR(TIM1_COMPA_vect) is defined
+ * here, idle() and calibrate() reprogram it): sketches linking TinySleep,
+ * or LoRaWAN, cannot use Timer1 nor define that handler.
+ */
+class TinySleep {
+  public:
+    /*!
+    * @brief Sleep in idle mode, woken up by Timer1 compare match
+    * @param ms sleep duration (milliseconds)
+    */
+    static void idle(uint16_t ms);
+
+    /*!
+    * @brief Sleep in power-down mode, woken up by the watchdog
+    * @param ms maximum sleep duration (milliseconds)
+    * @return Returns the compensated time actually slept (multiple of the WDT period, <= ms)
+    */
+    static uint16_t powerDown(uint16_t ms);
+
+    /*!
+    * @brief Measure the actual watchdog period against Timer1 (takes ~16 ms)
+    */
+    static void calibrate();
+
+    /*!
+    * @brief Sleep for ms milliseconds in the lowest power mode that keeps
+    *        the wake-up time accurate (power-down + idle)
+    * @param ms sleep duration (milliseconds)
+    */
+    static void wait(uint16_t ms);
+
+    /*!
+    * @brief True while the watchdog is timing a TinySleep sleep (or the
+    *        calibration): the sketch ISR(WDT_vect) should ignore that tick
+    */
+    static bool sleeping() { return _sleeping; }
+
+  private:
+    /*!
+    * @brief Start the watchdog in interrupt + reset mode
+    * @param prescaler WDP[3:0] value (0 = 16 ms ... 9 = 8 s)
+    */
+    static void startWatchdog(uint8_t prescaler);
+
+    /*!
+    * @brief Power-down for at most us microseconds
+    * @return Returns the compensated time actually slept (us)
+    */
+    static uint32_t sleepWatchdog(uint32_t us);
+
+    // Measured watchdog period for prescaler 0 (nominal 16 ms), in us
+    static uint16_t wdt_period;
+
+    // watchdog started by startWatchdog(), cleared once it is disabled
+    static volatile uint8_t _sleeping;
+};
+
+#endif
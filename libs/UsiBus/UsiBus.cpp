@@ -0,0 +1,63 @@
+#include "Arduino.h"
+#include <tinySPI.h>
+
+#include "UsiBus.h"
+
+// USI pins of the ATtiny84
+#define USI_DDR   DDRA
+#define USI_PORT  PORTA
+#define USI_SCK   PORTA4
+#define USI_DO    PORTA5
+#define USI_DI    PORTA6
+#define USI_PINS  ((1 << USI_SCK) | (1 << USI_DO) | (1 << USI_DI))
+
+
+UsiBus::Mode UsiBus::_mode = UsiBus::BUS_IDLE;
+
+
+void UsiBus::acquireSPI() {
+  if (!claim(BUS_SPI)) return;
+
+  // three-wire mode drives USCK and DO from the port latches: USCK must idle
+  // low (SPI mode 0, the first strobe is a rising edge)
+  USI_PORT &= ~((1 << USI_SCK) | (1 << USI_DO));
+  SPI.setDataMode(SPI_MODE0);
+  SPI.begin();
+}
+
+
+bool UsiBus::claim(Mode mode) {
+  if (_mode == mode) return false;
+
+  leave();
+  _mode = mode;
+  return true;
+}
+
+
+void UsiBus::release() {
+  leave();
+  PRR |= (1 << PRUSI);
+  _mode = BUS_IDLE;
+}
+
+
+UsiBus::Mode UsiBus::mode() {
+  return _mode;
+}
+
+
+/* ############### PRIVATE FUNCTIONS ################## */
+
+void UsiBus::leave() {
+  // USI registers are not writable while powered down
+  PRR &= ~(1 << PRUSI);
+
+  // pins back to the port: inputs with pull-up (no glitch, the lines are
+  // high in both modes when the bus is idle)
+  USICR = 0;
+  USI_PORT |= USI_PINS;
+  USI_DDR &= ~USI_PINS;
+
+  USISR = 0xF0;  // clear the flags and the counter
+}
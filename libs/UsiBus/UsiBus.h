@@ -0,0 +1,66 @@
+#ifndef USIBUS_H
+#define USIBUS_H
+
+#include <stdint.h>
+
+/*
+ * Owner of the ATtiny84 USI, shared by the SPI of the RFM95 (tinySPI) and
+ * the I2C of the sensors (TinyI2C): USCK/SCL = PA4, DI/SDA = PA6, DO = PA5.
+ *
+ * The RFM95 (acquireSPI()) and the sensor drivers (TinyI2C::acquire()) take
+ * the bus before each transfer, so the sketch never has to switch it by
+ * hand. Taking the bus in the mode it is already in costs one comparison;
+ * the USI is only reconfigured when the other peripheral had it. The I2C
+ * half lives in TinyI2C: a radio-only sketch does not link it.
+ *
+ *   aht20.resume();           // I2C
+ *   lora.Send_Data(...);      // SPI
+ *   UsiBus::release();        // before sleeping
+ *
+ * release() parks the lines for sleep: USI powered down, PA4/PA5/PA6 inputs
+ * with pull-up. The sensor pull-ups see no voltage across them and the
+ * RFM95 inputs do not float (NSS is kept high by the RFM95 library).
+ *
+ * NOTE: do not call SPI.begin()/end() or TinyI2C::begin() directly, the
+ * bus owner would not know about it. The bus is not used from interrupts.
+ */
+class UsiBus {
+  public:
+    enum Mode : uint8_t {
+      BUS_IDLE,
+      BUS_SPI,
+      BUS_I2C
+    };
+
+    /*!
+    * @brief Switch the USI to three-wire mode (SPI mode 0) if needed
+    */
+    static void acquireSPI();
+
+    /*!
+    * @brief Take the bus for a new owner
+    * @return Returns true if the caller must configure the USI (the pins of
+    *         the previous owner are parked), false if it already had it
+    */
+    static bool claim(Mode mode);
+
+    /*!
+    * @brief Power the USI down and park its pins in the lowest-leakage state
+    */
+    static void release();
+
+    /*!
+    * @brief Current owner of the bus
+    */
+    static Mode mode();
+
+  private:
+    /*!
+    * @brief Power the USI up, switch it off and park its pins
+    */
+    static void leave();
+
+    static Mode _mode;
+};
+
+#endif
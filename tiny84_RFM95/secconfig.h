@@ -14,3 +14,9 @@
 unsigned char NwkSkey[16] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x10, 0x11, 0x12, 0x13, 0x014, 0x15, 0x16 };
 unsigned char AppSkey[16] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x10, 0x11, 0x12, 0x13, 0x014, 0x15, 0x16 };
 unsigned char DevAddr[4] = { 0x00, 0x00, 0x00, 0x05};
+
+// ACTIVATION METHOD: OTAA (lora.setJoinKeys + lora.Join), msb left. NwkSkey, AppSkey and DevAddr
+// above are then overwritten with the session of the join.
+//unsigned char AppEui[8] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+//unsigned char DevEui[8] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+//unsigned char AppKey[16] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16 };
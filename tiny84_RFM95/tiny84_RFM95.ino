@@ -6,8 +6,9 @@
 #include <SoftwareSerial.h>
 
 #include "LoRaWAN.h"
+#include "FrameCounter.h"
 #include "secconfig.h"
-#include "tinySPI.h"
+#include "UsiBus.h"
 
 /* Add your include statements here */
 /* USER CODE BEGIN */
@@ -26,7 +27,7 @@ RFM95 rfm(DIO0, NSS);
 
 /* Define LoRaWAN layer */
 LoRaWAN lora = LoRaWAN(rfm);
-uint32_t Frame_Counter_Tx = 0x0000;
+FrameCounter Frame_Counter_Tx(0, 16, 32); // EEPROM ring: 16 slots from address 0, checkpoint every 32 frames
 const byte SF = 7;        // set spreading factor
 uint8_t PA_boost_on = 1;  // set power amplifier 
 uint8_t power_level = 14; // set Tx power
@@ -64,6 +65,10 @@ void setup() {
   // Initialize RFM module
   rfm.init(power_level, PA_boost_on);
   lora.setKeys(NwkSkey, AppSkey, DevAddr);
+  lora.setADR(1);  // SF and Tx power driven by the network (SF and power_level are the starting point)
+  Frame_Counter_Tx.begin(); // restore the frame counter after a reset
+
+  UsiBus::release(); // park the USI pins while sleeping
 }
 
 
@@ -71,6 +76,7 @@ void loop() {
 
   // sleep:
   goToSleep();
+  lora.Time_Elapsed(8000); // one watchdog period (ms), keeps the network duty cycle
 
   // Once awake check sleep counter:
   if (sleep_count >= sleep_total) { // if time to awake:
@@ -88,12 +94,12 @@ void loop() {
     delay(1);
 
     // transmit data
-    lora.Send_Data(Data, Data_Length, Frame_Counter_Tx, SF);
-
-    Frame_Counter_Tx++;
+    lora.Send_Data(Data, Data_Length, Frame_Counter_Tx.next(), SF);
 
     // reset sleep count
     sleep_count = 0;
+
+    UsiBus::release();
   }
   // come back to sleep
 }
@@ -211,9 +217,12 @@ void setup_unused_pins(){
   Interrupt handler: 
   - code here must be executed as fast as possible (increment counter or set a flag)!
   - declare sleep_count as volatile variable for faster execution;
+  - the timeouts of TinySleep (LoRaWAN receive windows, sensor waits) are not sleep cycles;
 */
 ISR(WDT_vect) {
-  sleep_count++; // keep track of how many sleep cycles have been completed.
+  if (!TinySleep::sleeping()) {
+    sleep_count++; // keep track of how many sleep cycles have been completed.
+  }
 }
 
 